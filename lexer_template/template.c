@@ -1,9 +1,63 @@
+#REGLEX_DECLARATIONS
+
 #include <stddef.h>
+#include <stdint.h>
+#ifdef REGLEX_FREESTANDING
+// Only the memory functions are used, which compilers expect in freestanding
+// environments as well
+void *memcpy(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
+#ifndef EOF
+#define EOF (-1)
+#endif
+
+// Compares the names of the parsers, which are switched to
+static inline int reglex_strcmp(const char *a, const char *b) {
+  while (*a != '\0' && *a == *b) {
+    a++;
+    b++;
+  }
+  return (unsigned char)*a - (unsigned char)*b;
+}
+#else
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#endif
 
-#REGLEX_DECLARATIONS
+#ifndef REGLEX_LEXERS
+#define REGLEX_LEXERS 1
+#endif
+
+#ifndef REGLEX_TOKEN_RING_SIZE
+#define REGLEX_TOKEN_RING_SIZE 16
+#endif
+
+// If no token is longer than REGLEX_MAX_TOKEN_LENGTH, all buffers are fixed
+// arrays. The input only has to hold the token and the lookahead of each lexer,
+// the lexems of the peeked tokens are copied out of it when it is full.
+// A freestanding lexer reads its whole input from the buffer of the caller, so
+// it never copies or drops input.
+#if defined(REGLEX_MAX_TOKEN_LENGTH) && !defined(REGLEX_FREESTANDING)
+#define REGLEX_FIXED_INPUT
+#ifndef REGLEX_INPUT_CAPACITY
+#define REGLEX_INPUT_CAPACITY                                                  \
+  (2 * REGLEX_LEXERS * (REGLEX_MAX_TOKEN_LENGTH + 1))
+#endif
+#endif
+
+// Static probes for tracers like bpftrace. A probe is a single nop, unless a
+// tracer is attached to it.
+#ifdef REGLEX_PROBES
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#else
+#error "the instruction probes requires <sys/sdt.h> (systemtap-sdt-dev)"
+#endif
+#define REGLEX_PROBE(name, ...) STAP_PROBEV(reglex, name, __VA_ARGS__)
+#else
+#define REGLEX_PROBE(name, ...)
+#endif
 
 typedef struct string {
   char *data;
@@ -16,6 +70,54 @@ typedef struct location {
   char eol;
 } location_t;
 
+// The state of one lexer. Positions are offsets in the input stream, so the
+// lexers can share the buffered input.
+typedef struct reglex_state {
+  void (*token_parser_fn)();
+  int checkpoint_tag;
+  int parse_result;
+  size_t token_start;
+  size_t checkpoint;
+  size_t pos;
+  location_t curr_loc;
+  location_t checkpoint_loc;
+  location_t lexem_start_loc;
+  location_t token_start_loc;
+  void (*token_start_parser_fn)();
+  char just_started_token;
+  char has_lexem;
+  string_t lexem;
+  size_t lexem_capacity;
+#ifdef REGLEX_MAX_TOKEN_LENGTH
+  char lexem_data[REGLEX_MAX_TOKEN_LENGTH + 1];
+#endif
+} reglex_state_t;
+
+// A token in the lookahead ring. The lexem points into the buffered input and
+// is not terminated by '\0'.
+typedef struct reglex_token {
+  int type;
+  int lexer;
+  const char *lexem;
+  size_t length;
+  int ln;
+  int col;
+} reglex_token_t;
+
+// A position in the input of a lexer, to which the lexer can be reset
+typedef struct reglex_snapshot {
+  int lexer;
+  size_t pos;
+  location_t loc;
+  void (*token_parser_fn)();
+} reglex_snapshot_t;
+
+#define REGLEX_INITIAL_STATE(parser_fn)                                        \
+  {                                                                            \
+    .token_parser_fn = parser_fn, .checkpoint_tag = -1, .parse_result = -1,   \
+    .curr_loc = {.ln = 1, .col = 0, .eol = 0},                                 \
+  }
+
 static void reglex_increment_loc(location_t *loc, int c) {
   if (loc->eol) {
     loc->eol = 0;
@@ -28,111 +130,682 @@ static void reglex_increment_loc(location_t *loc, int c) {
   loc->col++;
 }
 
-static void reglex_append_char_to_str(string_t *string, char c) {
-  string->length++;
-  string->data = realloc(string->data, (string->length + 1) * sizeof(char));
-  string->data[string->length - 1] = c;
-  string->data[string->length] = 0;
+static reglex_state_t reglex_states[REGLEX_LEXERS];
+static reglex_state_t *reglex_state = reglex_states;
+
+#ifdef REGLEX_PUSH
+// The transition table of a parser for push mode. State 0 is the dead state.
+// It is encoded as the generator was told with -T: dense with a row of 256
+// targets per state, with the rows over the classes of the bytes (ec), or with
+// the entries, in which a state differs from its default state, packed into a
+// comb. Only the dense table is folded at run time, the classes of the bytes
+// of the other encodings are folded already.
+typedef struct reglex_push_parser {
+  void (*token_parser_fn)();
+  void (*reject_fn)();
+#if defined(REGLEX_PUSH_COMB)
+  const unsigned char *classes;
+  const unsigned *base;
+  const unsigned short *defaults;
+  const unsigned short *check;
+  const unsigned short *next;
+#elif defined(REGLEX_PUSH_EC)
+  const unsigned char *classes;
+  const unsigned short *next;
+  unsigned short class_count;
+#else
+  const unsigned short (*next)[256];
+#endif
+  const short *tags;
+  unsigned short start;
+  unsigned short states;
+  unsigned short tag_count;
+  const unsigned char *fold;
+  char first_match;
+} reglex_push_parser_t;
+
+// The state of a lexer, which is fed with chunks of input. Only the bytes of
+// the unfinished token are kept, in a chunk from the slab pool. The location is
+// the one before the unfinished token, the checkpoint is relative to it.
+typedef struct reglex_push_ctx {
+  char *pending;
+  uint32_t pending_length;
+  uint32_t checkpoint;
+  int16_t checkpoint_tag;
+  uint16_t dfa_state;
+  uint8_t parser;
+  uint8_t pending_class;
+  char eol;
+  int ln;
+  int col;
+} reglex_push_ctx_t;
+
+// The code actions of all push contexts run on this state
+static reglex_state_t reglex_push_state;
+#endif
+
+// The input, which has been read, but may still be needed by a lexer
+#ifndef REGLEX_FREESTANDING
+static FILE *reglex_is = NULL;
+#endif
+static const char *reglex_filename_ = NULL;
+#ifdef REGLEX_FIXED_INPUT
+static char reglex_input_buffer[REGLEX_INPUT_CAPACITY];
+static char *reglex_input = reglex_input_buffer;
+static size_t reglex_input_capacity = REGLEX_INPUT_CAPACITY;
+#else
+static char *reglex_input = NULL;
+static size_t reglex_input_capacity = 0;
+#endif
+static size_t reglex_input_length = 0;
+static size_t reglex_input_offset = 0;
+#ifdef REGLEX_FIXED_INPUT
+// Set, if a REGLEX_INPUT_CAPACITY defined by the user is too small
+static char reglex_input_overflow = 0;
+#endif
+#ifdef REGLEX_FREESTANDING
+static char *reglex_memory = NULL;
+static size_t reglex_memory_size = 0;
+#endif
+
+// The tokens, which have been peeked but not consumed, and the positions at
+// which they start
+static reglex_token_t reglex_tokens[REGLEX_TOKEN_RING_SIZE];
+static reglex_snapshot_t reglex_token_starts[REGLEX_TOKEN_RING_SIZE];
+static int reglex_tokens_head = 0;
+static int reglex_tokens_count = 0;
+#ifdef REGLEX_FIXED_INPUT
+static char reglex_token_lexems[REGLEX_TOKEN_RING_SIZE]
+                               [REGLEX_MAX_TOKEN_LENGTH + 1];
+#endif
+
+// The input after the oldest snapshot, which has not been released, is kept
+static int reglex_snapshot_depth = 0;
+static size_t reglex_snapshot_pos = 0;
+
+#ifdef REGLEX_FREESTANDING
+// The whole input is in the buffer of the caller, nothing is read or dropped
+static int reglex_read_input() { return EOF; }
+static void reglex_trim_input() {}
+#else
+// Returns the position of the token, which the slowest lexer is parsing. If
+// is_held is set, the lexems of the peeked tokens and the snapshots, whose
+// input has not been dropped yet, are kept as well.
+static size_t reglex_input_keep(char is_held) {
+  size_t keep = reglex_states[0].token_start;
+  for (int i = 1; i < REGLEX_LEXERS; i++) {
+    if (reglex_states[i].token_start < keep) {
+      keep = reglex_states[i].token_start;
+    }
+  }
+  if (!is_held) {
+    return keep;
+  }
+  for (int i = 0; i < reglex_tokens_count; i++) {
+    size_t start =
+        reglex_token_starts[(reglex_tokens_head + i) % REGLEX_TOKEN_RING_SIZE]
+            .pos;
+    if (start < keep) {
+      keep = start;
+    }
+  }
+  if (reglex_snapshot_depth > 0 && reglex_snapshot_pos < keep) {
+    keep = reglex_snapshot_pos;
+  }
+  return keep < reglex_input_offset ? reglex_input_offset : keep;
 }
 
-static void reglex_append_str_to_str_n(string_t *dest, string_t *src,
-                                       size_t n) {
-  size_t old_len = dest->length;
-  dest->length += n;
-  dest->data = realloc(dest->data, (dest->length + 1) * sizeof(char));
-  memcpy(&dest->data[old_len], src->data, n);
-  dest->data[dest->length] = '\0';
+static void reglex_drop_input(size_t keep) {
+  size_t n = keep - reglex_input_offset;
+  memmove(reglex_input, &reglex_input[n], reglex_input_length - n);
+  reglex_input_length -= n;
+  reglex_input_offset += n;
 }
 
-static void reglex_shift_str(string_t *str, size_t n) {
-  if (n > 0) {
-    memmove(str->data, &str->data[n], str->length - n + 1);
-    str->length -= n;
+#ifdef REGLEX_FIXED_INPUT
+// Makes room in the full buffer. The lexems of the peeked tokens before the
+// slowest lexer are copied out of the buffer and the input of the snapshots
+// is dropped, so restoring them fails.
+static void reglex_make_room() {
+  size_t keep = reglex_input_keep(0);
+  for (int i = 0; i < reglex_tokens_count; i++) {
+    int slot = (reglex_tokens_head + i) % REGLEX_TOKEN_RING_SIZE;
+    size_t start = reglex_token_starts[slot].pos;
+    if (start >= reglex_input_offset && start < keep) {
+      memcpy(reglex_token_lexems[slot],
+             &reglex_input[start - reglex_input_offset],
+             reglex_tokens[slot].length);
+    }
   }
+  reglex_drop_input(keep);
 }
+#endif
 
-static void reglex_clear_str(string_t *string) {
-  free(string->data);
-  string->data = NULL;
-  string->length = 0;
+static int reglex_read_input() {
+  int c = fgetc(reglex_is);
+  if (c == EOF) {
+    return EOF;
+  }
+  if (reglex_input_length == reglex_input_capacity) {
+#ifdef REGLEX_FIXED_INPUT
+    // The default capacity holds the tokens of all lexers, only a smaller
+    // REGLEX_INPUT_CAPACITY can still be full
+    reglex_make_room();
+    if (reglex_input_length == reglex_input_capacity) {
+      ungetc(c, reglex_is);
+      reglex_input_overflow = 1;
+      return EOF;
+    }
+#else
+    reglex_input_capacity =
+        reglex_input_capacity == 0 ? 64 : 2 * reglex_input_capacity;
+    reglex_input = realloc(reglex_input, reglex_input_capacity);
+#endif
+    REGLEX_PROBE(refill, reglex_input_offset + reglex_input_length,
+                 reglex_input_capacity);
+  }
+  reglex_input[reglex_input_length++] = c;
+  return c;
 }
 
-static int reglex_checkpoint_tag = -1;
-static string_t reglex_lexem_str = {.data = NULL, .length = 0};
-static string_t reglex_read_ahead = {.data = NULL, .length = 0};
-static int reglex_read_ahead_ptr = 0;
-
-static location_t reglex_curr_loc = {.ln = 1, .col = 0, .eol = 0};
-static location_t reglex_checkpoint_loc;
-static location_t reglex_lexem_start_loc;
+// Drops the input before the token, which the slowest lexer is parsing, before
+// the lexems of the peeked tokens and before the snapshots. The buffer is only
+// compacted once at least half of it can be dropped.
+static void reglex_trim_input() {
+  size_t keep = reglex_input_keep(1);
+  size_t n = keep - reglex_input_offset;
+  if (n > 0 && 2 * n >= reglex_input_length) {
+    reglex_drop_input(keep);
+  }
+}
+#endif
 
-int reglex_accept(int tag) {
-  reglex_checkpoint_tag = tag;
-  reglex_checkpoint_loc = reglex_curr_loc;
-  size_t chars_to_accept = reglex_read_ahead.length - reglex_read_ahead_ptr;
-  reglex_append_str_to_str_n(&reglex_lexem_str, &reglex_read_ahead,
-                             chars_to_accept);
-  reglex_shift_str(&reglex_read_ahead, chars_to_accept);
+static int reglex_accept(int tag) {
+  reglex_state_t *state = reglex_state;
+  state->checkpoint_tag = tag;
+  state->checkpoint = state->pos;
+  state->checkpoint_loc = state->curr_loc;
+  state->has_lexem = 0;
   return 0;
 }
 
 #REGLEX_PARSER_SWITCHING
 
-const char *reglex_lexem() { return reglex_lexem_str.data; }
+// The lexem is only copied out of the input, when it is asked for
+const char *reglex_lexem() {
+  reglex_state_t *state = reglex_state;
+  if (!state->has_lexem) {
+    size_t length = state->checkpoint - state->token_start;
+#ifdef REGLEX_MAX_TOKEN_LENGTH
+    state->lexem.data = state->lexem_data;
+#elif defined(REGLEX_FREESTANDING)
+    size_t share = reglex_memory_size / REGLEX_LEXERS;
+    if (length + 1 > share) {
+      return NULL;
+    }
+    state->lexem.data = &reglex_memory[(state - reglex_states) * share];
+#else
+    if (length + 1 > state->lexem_capacity) {
+      state->lexem_capacity = 2 * (length + 1);
+      state->lexem.data = realloc(state->lexem.data, state->lexem_capacity);
+    }
+#endif
+    memcpy(state->lexem.data,
+           &reglex_input[state->token_start - reglex_input_offset], length);
+    state->lexem.data[length] = '\0';
+    state->lexem.length = length;
+    state->has_lexem = 1;
+  }
+  return state->lexem.data;
+}
+
+int reglex_lexer() {
+#ifdef REGLEX_PUSH
+  if (reglex_state == &reglex_push_state) {
+    return 0;
+  }
+#endif
+  return reglex_state - reglex_states;
+}
 
 int reglex_parse_result = -1;
+int reglex_token_type = -1;
+
+#ifdef REGLEX_PROFILE
+#include <time.h>
+
+// Values below 8 have a bucket each, larger values are split into 8 buckets
+// per power of two, so a bucket is at most 12.5% wider than its lower bound
+#define REGLEX_HISTOGRAM_BUCKETS 328
+
+typedef struct reglex_histogram {
+  uint64_t count;
+  uint64_t max;
+  uint32_t buckets[REGLEX_HISTOGRAM_BUCKETS];
+} reglex_histogram_t;
+
+// A token rule of the spec, numbered in the order of the parsers
+typedef struct reglex_profile_rule {
+  int lexer;
+  const char *parser;
+  int ln;
+} reglex_profile_rule_t;
+
+// The time stamp counter is read on x86, as it costs only a few cycles
+#if defined(__x86_64__) || defined(__i386__)
+#define REGLEX_PROFILE_UNIT "tsc cycles"
+static inline uint64_t reglex_profile_now() { return __builtin_ia32_rdtsc(); }
+#else
+#define REGLEX_PROFILE_UNIT "ns"
+static inline uint64_t reglex_profile_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+static void reglex_histogram_add(reglex_histogram_t *h, uint64_t value) {
+  int bucket = (int)value;
+  if (value >= 8) {
+    int exp = 63 - __builtin_clzll(value);
+    bucket = (exp - 2) * 8 + (int)((value >> (exp - 3)) & 7);
+    if (bucket >= REGLEX_HISTOGRAM_BUCKETS) {
+      bucket = REGLEX_HISTOGRAM_BUCKETS - 1;
+    }
+  }
+  h->buckets[bucket]++;
+  h->count++;
+  if (value > h->max) {
+    h->max = value;
+  }
+}
+
+// Returns the upper bound of the bucket, which contains the quantile q
+static uint64_t reglex_histogram_quantile(const reglex_histogram_t *h,
+                                          double q) {
+  uint64_t rank = (uint64_t)(q * h->count);
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < REGLEX_HISTOGRAM_BUCKETS; bucket++) {
+    seen += h->buckets[bucket];
+    if (seen > rank) {
+      if (bucket < 8) {
+        return bucket;
+      }
+      int exp = bucket / 8 + 2;
+      uint64_t upper = ((uint64_t)(9 + bucket % 8) << (exp - 3)) - 1;
+      return upper < h->max ? upper : h->max;
+    }
+  }
+  return h->max;
+}
+
+// The time per call to reglex_parse_token and, per rule, the time of the
+// calls, which parsed a token of the rule, and of its code action
+static reglex_histogram_t reglex_profile_calls;
+static reglex_histogram_t reglex_profile_tokens[REGLEX_PROFILE_RULES];
+static reglex_histogram_t reglex_profile_actions[REGLEX_PROFILE_RULES];
+static int reglex_profile_rule = -1;
+static uint64_t reglex_profile_action_start = 0;
+
+// The bytes read again after each token and the length of the lexems per
+// rule. The buffers only grow, until they are trimmed at the start of a token,
+// so their peak is taken after each token.
+static reglex_histogram_t reglex_profile_backtracks;
+static reglex_histogram_t reglex_profile_lengths[REGLEX_PROFILE_RULES];
+static size_t reglex_profile_peak_input = 0;
+static size_t reglex_profile_peak_pending = 0;
+
+static void reglex_profile_action_begin(int first_rule) {
+  int tag = reglex_state->checkpoint_tag;
+  reglex_profile_rule = tag == -1 ? -1 : first_rule + tag;
+  reglex_profile_action_start = reglex_profile_now();
+}
+
+// The lexem is measured after the code action, as a trailing context may have
+// shortened it
+static void reglex_profile_action_end() {
+  if (reglex_profile_rule != -1) {
+    reglex_state_t *state = reglex_state;
+    reglex_histogram_add(&reglex_profile_actions[reglex_profile_rule],
+                         reglex_profile_now() - reglex_profile_action_start);
+    reglex_histogram_add(&reglex_profile_lengths[reglex_profile_rule],
+                         state->checkpoint - state->token_start);
+  }
+}
+#endif
 
 static void reglex_reset_to_checkpoint() {
-  reglex_checkpoint_tag = -1;
-  reglex_curr_loc = reglex_checkpoint_loc;
-  reglex_clear_str(&reglex_lexem_str);
-  reglex_read_ahead_ptr = reglex_read_ahead.length;
+  reglex_state_t *state = reglex_state;
+  if (state->checkpoint_tag != -1) {
+    REGLEX_PROBE(token, reglex_lexer(), state->checkpoint_tag,
+                 state->token_start, state->checkpoint - state->token_start);
+#ifdef REGLEX_PROFILE
+    reglex_histogram_add(&reglex_profile_backtracks,
+                         state->pos - state->checkpoint);
+#endif
+  }
+  state->checkpoint_tag = -1;
+  state->pos = state->checkpoint;
+  state->curr_loc = state->checkpoint_loc;
 }
 
-static FILE *reglex_is = NULL;
-static const char *reglex_filename_ = NULL;
+// Called when no token could be matched: either the input ended right at the
+// start of the token or the input does not match any token
+static void reglex_no_token() {
+  reglex_parse_result =
+      reglex_state->pos == reglex_state->token_start ? 0 : 1;
+  if (reglex_parse_result == 1) {
+    REGLEX_PROBE(error, reglex_lexer(), reglex_state->token_start,
+                 reglex_state->lexem_start_loc.ln,
+                 reglex_state->lexem_start_loc.col);
+  }
+}
 
+#ifdef REGLEX_FREESTANDING
+// The input is parsed in place, so it must stay valid and unchanged while the
+// lexer runs. The lexers start at its beginning again, with their default
+// parsers.
+void reglex_set_input(const char *input, size_t length, const char *filename) {
+  reglex_input = (char *)input;
+  reglex_input_length = length;
+  reglex_input_capacity = length;
+  reglex_input_offset = 0;
+  reglex_filename_ = filename;
+  for (int i = 0; i < REGLEX_LEXERS; i++) {
+    reglex_states[i] = reglex_initial_states[i];
+  }
+  reglex_state = reglex_states;
+  reglex_parse_result = -1;
+  reglex_tokens_count = 0;
+  reglex_snapshot_depth = 0;
+}
+
+// The lexems are copied to the memory of the caller, each lexer gets an equal
+// share of it
+void reglex_set_memory(void *memory, size_t size) {
+  reglex_memory = memory;
+  reglex_memory_size = size;
+  for (int i = 0; i < REGLEX_LEXERS; i++) {
+    reglex_states[i].has_lexem = 0;
+  }
+}
+#else
 void reglex_set_is(FILE *is, const char *filename) {
   reglex_is = is;
   reglex_filename_ = filename;
-  reglex_curr_loc.ln = 1;
-  reglex_curr_loc.col = 0;
-  reglex_curr_loc.eol = 0;
+  for (int i = 0; i < REGLEX_LEXERS; i++) {
+    reglex_states[i].curr_loc.ln = 1;
+    reglex_states[i].curr_loc.col = 0;
+    reglex_states[i].curr_loc.eol = 0;
+  }
 }
+#endif
 
 const char *reglex_filename() { return reglex_filename_; }
-int reglex_col() { return reglex_lexem_start_loc.col; }
-int reglex_ln() { return reglex_lexem_start_loc.ln; }
+int reglex_col() { return reglex_state->lexem_start_loc.col; }
+int reglex_ln() { return reglex_state->lexem_start_loc.ln; }
 
-#REGLEX_REJECT_FUNCTIONS
+#ifdef REGLEX_TRAILING_CONTEXT
+// Ends the lexem after its first split bytes and gives the rest back to the
+// input
+static void reglex_cut_lexem(size_t split) {
+  reglex_state_t *state = reglex_state;
+  if (split == 0 || split >= state->checkpoint - state->token_start) {
+    return;
+  }
+  const char *lexem = &reglex_input[state->token_start - reglex_input_offset];
+  state->checkpoint = state->token_start + split;
+  state->has_lexem = 0;
+  state->checkpoint_loc = state->lexem_start_loc;
+  for (size_t i = 1; i < split; i++) {
+    reglex_increment_loc(&state->checkpoint_loc, lexem[i]);
+  }
+}
+#endif
 
-static char reglex_just_started_token = 0;
+// If neither the head nor the tail of a rule has a fixed length, the lexem is
+// split by running the matchers of the head and the tail over it again
+#ifdef REGLEX_TRAILING_MATCHERS
+// Without memory for the marks, a freestanding lexer tries each split with the
+// head and the tail, instead of marking the ends of the head in one pass
+#if defined(REGLEX_FREESTANDING) && !defined(REGLEX_MAX_TOKEN_LENGTH)
+#define REGLEX_TRAILING_RESCAN
+#else
+#ifdef REGLEX_MAX_TOKEN_LENGTH
+static char reglex_trailing_marks[REGLEX_MAX_TOKEN_LENGTH + 1];
+#else
+static char *reglex_trailing_marks = NULL;
+#endif
+static size_t reglex_trailing_start = 0;
+static char reglex_trailing_marking = 0;
+#endif
+static size_t reglex_trailing_pos = 0;
+static size_t reglex_trailing_end = 0;
+static char reglex_trailing_matched = 0;
 
-int reglex_next() {
+static int reglex_trailing_next() {
+  if (reglex_trailing_pos == reglex_trailing_end) {
+    return EOF;
+  }
+  return (unsigned char)
+      reglex_input[reglex_trailing_pos++ - reglex_input_offset];
+}
+
+static int reglex_trailing_accept(int tag) {
+#ifndef REGLEX_TRAILING_RESCAN
+  if (reglex_trailing_marking) {
+    reglex_trailing_marks[reglex_trailing_pos - reglex_trailing_start] = 1;
+    return 0;
+  }
+#endif
+  if (reglex_trailing_pos == reglex_trailing_end) {
+    reglex_trailing_matched = 1;
+  }
+  return 0;
+}
+
+static void reglex_trailing_reject() {}
+
+// Returns whether the matcher accepts exactly the input from from to to
+static char reglex_trailing_matches(void (*matcher)(), size_t from, size_t to) {
+  reglex_trailing_pos = from;
+  reglex_trailing_end = to;
+  reglex_trailing_matched = 0;
+  matcher();
+  return reglex_trailing_matched;
+}
+
+// Splits the lexem after the longest head, which is followed by a matching
+// tail, and gives the tail back to the input. Only the lexem in memory is
+// scanned again, the input is not read again. The tail is run from each end of
+// the head, so a head, whose ends overlap the tail, takes quadratic time.
+static void reglex_split_lexem(void (*head)(), void (*tail)()) {
+  reglex_state_t *state = reglex_state;
+  size_t length = state->checkpoint - state->token_start;
+#ifdef REGLEX_TRAILING_RESCAN
+  size_t split = length;
+  while (split > 0) {
+    size_t end = state->token_start + split;
+    if (reglex_trailing_matches(head, state->token_start, end) &&
+        reglex_trailing_matches(tail, end, state->checkpoint)) {
+      break;
+    }
+    split--;
+  }
+#else
+#ifndef REGLEX_MAX_TOKEN_LENGTH
+  reglex_trailing_marks = realloc(reglex_trailing_marks, length + 1);
+#endif
+  memset(reglex_trailing_marks, 0, length + 1);
+  reglex_trailing_marking = 1;
+  reglex_trailing_start = state->token_start;
+  reglex_trailing_pos = state->token_start;
+  reglex_trailing_end = state->checkpoint;
+  head();
+  reglex_trailing_marking = 0;
+
+  size_t split = length;
+  while (split > 0) {
+    if (reglex_trailing_marks[split] &&
+        reglex_trailing_matches(tail, state->token_start + split,
+                                state->checkpoint)) {
+      break;
+    }
+    split--;
+  }
+#endif
+  reglex_cut_lexem(split);
+}
+#endif
+
+#REGLEX_REJECT_FUNCTIONS
+
+static int reglex_next() {
+  reglex_state_t *state = reglex_state;
   int c;
-  if (reglex_read_ahead_ptr > 0) {
-    c = reglex_read_ahead
-            .data[reglex_read_ahead.length - reglex_read_ahead_ptr--];
+  if (state->pos - reglex_input_offset < reglex_input_length) {
+    c = (unsigned char)reglex_input[state->pos - reglex_input_offset];
   } else {
-    c = fgetc(reglex_is);
-    if (c != EOF) {
-      reglex_append_char_to_str(&reglex_read_ahead, c);
+    c = reglex_read_input();
+    if (c == EOF) {
+      return EOF;
     }
   }
-  reglex_increment_loc(&reglex_curr_loc, c);
-  if (reglex_just_started_token) {
-    reglex_just_started_token = 0;
-    reglex_lexem_start_loc = reglex_curr_loc;
+  state->pos++;
+  reglex_increment_loc(&state->curr_loc, c);
+  if (state->just_started_token) {
+    state->just_started_token = 0;
+    state->lexem_start_loc = state->curr_loc;
   }
   return c;
 }
 
+#ifdef REGLEX_BIT_PARALLEL
+#define REGLEX_BP_MAX_WORDS 8
+
+// The tables of a parser, which is simulated bit-parallel. Each bit stands for
+// a position (a char transition) in the parser's automaton.
+typedef struct reglex_bp {
+  int words;
+  int tag_count;
+  const uint64_t *first;
+  const uint64_t *chars;
+  const uint64_t *follow;
+  const uint64_t *accept;
+  const uint64_t *accept_any;
+  const int *tags;
+} reglex_bp_t;
+
+// Runs all positions of the parser at once. A position is active, if it can be
+// reached by the chars read so far. The positions following the active ones
+// are collected four positions at a time. Like the dfa, the simulation accepts
+// the highest priority tag after each char and stops once no position is left.
+static inline void reglex_bp_run(const reglex_bp_t *bp, int (*next)(),
+                                 void (*reject)()) {
+  const int words = bp->words;
+  uint64_t active[REGLEX_BP_MAX_WORDS];
+  uint64_t follow[REGLEX_BP_MAX_WORDS];
+  const uint64_t *reachable = bp->first;
+  int c;
+  while ((c = next()) != EOF) {
+    const uint64_t *chars = &bp->chars[c * words];
+    uint64_t any = 0;
+    uint64_t accepting = 0;
+    for (int w = 0; w < words; w++) {
+      active[w] = reachable[w] & chars[w];
+      any |= active[w];
+      accepting |= active[w] & bp->accept_any[w];
+    }
+    if (!any) {
+      break;
+    }
+    for (int t = 0; accepting && t < bp->tag_count; t++) {
+      const uint64_t *mask = &bp->accept[t * words];
+      for (int w = 0; w < words; w++) {
+        if (active[w] & mask[w]) {
+          reglex_accept(bp->tags[t]);
+          accepting = 0;
+          break;
+        }
+      }
+    }
+    memset(follow, 0, sizeof(follow));
+    for (int w = 0; w < words; w++) {
+      uint64_t bits = active[w];
+      for (int group = w * 16; bits != 0; group++, bits >>= 4) {
+        const uint64_t *entry = &bp->follow[(group * 16 + (bits & 15)) * words];
+        for (int v = 0; v < words; v++) {
+          follow[v] |= entry[v];
+        }
+      }
+    }
+    reachable = follow;
+  }
+  reject();
+}
+#endif
+
+#REGLEX_NEXT_FUNCTIONS
+
+// With several lexers, the lexer furthest behind in the input parses the next
+// token, so the input is only buffered as long as the lexers are apart.
 int reglex_parse_token() {
+#ifndef REGLEX_FREESTANDING
   if (reglex_is == NULL) {
     reglex_is = stdin;
   }
-  reglex_just_started_token = 1;
-  reglex_token_parser_fn();
+#endif
+#if REGLEX_LEXERS > 1
+  reglex_state_t *next = NULL;
+  for (int i = 0; i < REGLEX_LEXERS; i++) {
+    if (reglex_states[i].parse_result == -1 &&
+        (next == NULL || reglex_states[i].pos < next->pos)) {
+      next = &reglex_states[i];
+    }
+  }
+  if (next == NULL) {
+    return reglex_parse_result = 0;
+  }
+  reglex_state = next;
+  reglex_parse_result = -1;
+#endif
+  reglex_state_t *state = reglex_state;
+  state->token_start = state->pos;
+  state->checkpoint = state->pos;
+  state->checkpoint_loc = state->curr_loc;
+  state->token_start_loc = state->curr_loc;
+  state->token_start_parser_fn = state->token_parser_fn;
+  state->just_started_token = 1;
+  reglex_token_type = -1;
+  reglex_trim_input();
+#ifdef REGLEX_PROFILE
+  uint64_t profile_start = reglex_profile_now();
+  reglex_profile_rule = -1;
+#endif
+  state->token_parser_fn();
+#ifdef REGLEX_FIXED_INPUT
+  if (reglex_input_overflow) {
+    reglex_parse_result = 1;
+  }
+#endif
+#ifdef REGLEX_PROFILE
+  uint64_t elapsed = reglex_profile_now() - profile_start;
+  reglex_histogram_add(&reglex_profile_calls, elapsed);
+  if (reglex_profile_rule != -1) {
+    reglex_histogram_add(&reglex_profile_tokens[reglex_profile_rule], elapsed);
+  }
+  if (reglex_input_length > reglex_profile_peak_input) {
+    reglex_profile_peak_input = reglex_input_length;
+  }
+#endif
+#if REGLEX_LEXERS > 1
+  state->parse_result = reglex_parse_result;
+  for (int i = 0; i < REGLEX_LEXERS && reglex_parse_result == 0; i++) {
+    if (reglex_states[i].parse_result == -1) {
+      reglex_parse_result = -1;
+    }
+  }
+#endif
   return reglex_parse_result;
 }
 
@@ -144,4 +817,560 @@ int reglex_parse() {
   return result;
 }
 
+#ifdef REGLEX_PROFILE
+static void reglex_histogram_print(FILE *out, const char *label,
+                                   const reglex_histogram_t *h) {
+  fprintf(out, "%-32s %10llu %10llu %10llu %10llu %10llu\n", label,
+          (unsigned long long)h->count,
+          (unsigned long long)reglex_histogram_quantile(h, 0.5),
+          (unsigned long long)reglex_histogram_quantile(h, 0.99),
+          (unsigned long long)reglex_histogram_quantile(h, 0.999),
+          (unsigned long long)h->max);
+}
+
+static void reglex_profile_rule_name(int i, char *name, size_t size) {
+  const reglex_profile_rule_t *rule = &reglex_profile_rules[i];
+  if (REGLEX_LEXERS > 1) {
+    snprintf(name, size, "%d:%s:%d", rule->lexer, rule->parser, rule->ln);
+  } else {
+    snprintf(name, size, "%s:%d", rule->parser, rule->ln);
+  }
+}
+
+// Prints the percentiles of the calls and, for each rule which has parsed a
+// token, of its tokens and its code action. Then the percentiles of the
+// backtracking and the lexem lengths and the peak size of the buffers follow.
+void reglex_profile_dump(FILE *out) {
+  char name[48];
+  char label[64];
+  fprintf(out, "%-32s %10s %10s %10s %10s %10s\n",
+          "reglex profile (" REGLEX_PROFILE_UNIT ")", "count", "p50", "p99",
+          "p999", "max");
+  reglex_histogram_print(out, "parse_token", &reglex_profile_calls);
+  for (int i = 0; i < REGLEX_PROFILE_RULES; i++) {
+    if (reglex_profile_actions[i].count == 0) {
+      continue;
+    }
+    reglex_profile_rule_name(i, name, sizeof(name));
+    snprintf(label, sizeof(label), "%s token", name);
+    reglex_histogram_print(out, label, &reglex_profile_tokens[i]);
+    snprintf(label, sizeof(label), "%s action", name);
+    reglex_histogram_print(out, label, &reglex_profile_actions[i]);
+  }
+
+  fprintf(out, "%-32s %10s %10s %10s %10s %10s\n", "reglex profile (bytes)",
+          "count", "p50", "p99", "p999", "max");
+  reglex_histogram_print(out, "backtrack", &reglex_profile_backtracks);
+  for (int i = 0; i < REGLEX_PROFILE_RULES; i++) {
+    if (reglex_profile_lengths[i].count == 0) {
+      continue;
+    }
+    reglex_profile_rule_name(i, name, sizeof(name));
+    snprintf(label, sizeof(label), "%s length", name);
+    reglex_histogram_print(out, label, &reglex_profile_lengths[i]);
+  }
+#ifdef REGLEX_MAX_TOKEN_LENGTH
+  // The lexems of bounded lexers have arrays of a fixed size
+  size_t peak_lexem = REGLEX_MAX_TOKEN_LENGTH + 1;
+#else
+  size_t peak_lexem = 0;
+  for (int i = 0; i < REGLEX_LEXERS; i++) {
+    if (reglex_states[i].lexem_capacity > peak_lexem) {
+      peak_lexem = reglex_states[i].lexem_capacity;
+    }
+  }
+#ifdef REGLEX_PUSH
+  if (reglex_push_state.lexem_capacity > peak_lexem) {
+    peak_lexem = reglex_push_state.lexem_capacity;
+  }
+#endif
+#endif
+#ifdef REGLEX_PUSH
+  fprintf(out, "peak pending bytes %zu, ", reglex_profile_peak_pending);
+#endif
+  fprintf(out, "peak input buffer %zu (capacity %zu), peak lexem buffer %zu\n",
+          reglex_profile_peak_input, reglex_input_capacity, peak_lexem);
+}
+
+void reglex_profile_reset() {
+  memset(&reglex_profile_calls, 0, sizeof(reglex_profile_calls));
+  memset(reglex_profile_tokens, 0, sizeof(reglex_profile_tokens));
+  memset(reglex_profile_actions, 0, sizeof(reglex_profile_actions));
+  memset(&reglex_profile_backtracks, 0, sizeof(reglex_profile_backtracks));
+  memset(reglex_profile_lengths, 0, sizeof(reglex_profile_lengths));
+  reglex_profile_peak_input = 0;
+  reglex_profile_peak_pending = 0;
+}
+#endif
+
+// Parses tokens until the k-th token (counting from 0), which has been given a
+// type by its code action, is in the ring. Tokens without a type are skipped.
+const reglex_token_t *reglex_peek_token(int k) {
+  if (k < 0 || k >= REGLEX_TOKEN_RING_SIZE) {
+    return NULL;
+  }
+  while (reglex_tokens_count <= k) {
+    int result = reglex_parse_token();
+    if (reglex_token_type != -1) {
+      reglex_state_t *state = reglex_state;
+      int slot = (reglex_tokens_head + reglex_tokens_count++) %
+                 REGLEX_TOKEN_RING_SIZE;
+      reglex_tokens[slot].type = reglex_token_type;
+      reglex_tokens[slot].lexer = reglex_lexer();
+      reglex_tokens[slot].length = state->checkpoint - state->token_start;
+      reglex_tokens[slot].ln = state->lexem_start_loc.ln;
+      reglex_tokens[slot].col = state->lexem_start_loc.col;
+      reglex_token_starts[slot] = (reglex_snapshot_t){
+          .lexer = reglex_lexer(),
+          .pos = state->token_start,
+          .loc = state->token_start_loc,
+          .token_parser_fn = state->token_start_parser_fn,
+      };
+    } else if (result != -1) {
+      return NULL;
+    }
+  }
+  // The input may have been moved while parsing
+  for (int i = 0; i < reglex_tokens_count; i++) {
+    int slot = (reglex_tokens_head + i) % REGLEX_TOKEN_RING_SIZE;
+#ifdef REGLEX_FIXED_INPUT
+    if (reglex_token_starts[slot].pos < reglex_input_offset) {
+      reglex_tokens[slot].lexem = reglex_token_lexems[slot];
+      continue;
+    }
+#endif
+    reglex_tokens[slot].lexem =
+        &reglex_input[reglex_token_starts[slot].pos - reglex_input_offset];
+  }
+  return &reglex_tokens[(reglex_tokens_head + k) % REGLEX_TOKEN_RING_SIZE];
+}
+
+void reglex_consume_token() {
+  if (reglex_tokens_count == 0 && reglex_peek_token(0) == NULL) {
+    return;
+  }
+  reglex_tokens_head = (reglex_tokens_head + 1) % REGLEX_TOKEN_RING_SIZE;
+  reglex_tokens_count--;
+}
+
+// Captures the position of the lexer, which parsed the last token. If tokens
+// have been peeked, the snapshot is taken before the first of them. The input
+// after the snapshot is kept until it is released.
+reglex_snapshot_t reglex_snapshot() {
+  reglex_snapshot_t snapshot;
+  if (reglex_tokens_count > 0) {
+    snapshot = reglex_token_starts[reglex_tokens_head];
+  } else {
+    snapshot.lexer = reglex_lexer();
+    snapshot.pos = reglex_state->pos;
+    snapshot.loc = reglex_state->curr_loc;
+    snapshot.token_parser_fn = reglex_state->token_parser_fn;
+  }
+  if (reglex_snapshot_depth++ == 0 || snapshot.pos < reglex_snapshot_pos) {
+    reglex_snapshot_pos = snapshot.pos;
+  }
+  return snapshot;
+}
+
+// Snapshots are released in the reverse order, in which they were taken, so
+// the oldest snapshot is released last and its position is kept until then
+void reglex_release(reglex_snapshot_t snapshot) {
+  if (reglex_snapshot_depth > 0) {
+    reglex_snapshot_depth--;
+  }
+}
+
+// Resets the lexer to the snapshot and drops the peeked tokens. Returns 1 if
+// the input at the snapshot has already been dropped.
+int reglex_restore(reglex_snapshot_t snapshot) {
+  if (snapshot.pos < reglex_input_offset) {
+    return 1;
+  }
+  reglex_state = &reglex_states[snapshot.lexer];
+  reglex_state_t *state = reglex_state;
+  state->token_parser_fn = snapshot.token_parser_fn;
+  state->checkpoint_tag = -1;
+  state->parse_result = -1;
+  state->token_start = snapshot.pos;
+  state->checkpoint = snapshot.pos;
+  state->pos = snapshot.pos;
+  state->curr_loc = snapshot.loc;
+  state->checkpoint_loc = snapshot.loc;
+  state->has_lexem = 0;
+  reglex_parse_result = -1;
+  reglex_tokens_count = 0;
+  return 0;
+}
+
+#ifdef REGLEX_PUSH
+#define REGLEX_SLAB_MIN 16
+#define REGLEX_SLAB_CLASSES 13
+#define REGLEX_SLAB_SIZE 65536
+
+// Chunks of 16 << size_class bytes. Each size class has a free list, which is
+// refilled with a whole slab at once. Larger chunks are allocated on their own.
+static char *reglex_slab_free[REGLEX_SLAB_CLASSES];
+static size_t reglex_slab_bytes = 0;
+
+static char *reglex_slab_alloc(int size_class) {
+  size_t size = (size_t)REGLEX_SLAB_MIN << size_class;
+  if (size_class >= REGLEX_SLAB_CLASSES) {
+    return malloc(size);
+  }
+  if (reglex_slab_free[size_class] == NULL) {
+    size_t count = REGLEX_SLAB_SIZE / size;
+    char *slab = malloc(size * count);
+    reglex_slab_bytes += size * count;
+    for (size_t i = 0; i < count; i++) {
+      memcpy(&slab[i * size], &reglex_slab_free[size_class], sizeof(char *));
+      reglex_slab_free[size_class] = &slab[i * size];
+    }
+  }
+  char *chunk = reglex_slab_free[size_class];
+  memcpy(&reglex_slab_free[size_class], chunk, sizeof(char *));
+  return chunk;
+}
+
+static void reglex_slab_release(char *chunk, int size_class) {
+  if (size_class >= REGLEX_SLAB_CLASSES) {
+    free(chunk);
+    return;
+  }
+  memcpy(chunk, &reglex_slab_free[size_class], sizeof(char *));
+  reglex_slab_free[size_class] = chunk;
+}
+
+static void reglex_push_release(reglex_push_ctx_t *ctx) {
+  if (ctx->pending != NULL) {
+    reglex_slab_release(ctx->pending, ctx->pending_class);
+    ctx->pending = NULL;
+  }
+  ctx->pending_length = 0;
+}
+
+// Makes room for length pending bytes
+static void reglex_push_reserve(reglex_push_ctx_t *ctx, size_t length) {
+  if (ctx->pending != NULL &&
+      length <= (size_t)REGLEX_SLAB_MIN << ctx->pending_class) {
+    return;
+  }
+  int size_class = 0;
+  while ((size_t)REGLEX_SLAB_MIN << size_class < length) {
+    size_class++;
+  }
+  char *pending = reglex_slab_alloc(size_class);
+  if (ctx->pending != NULL) {
+    memcpy(pending, ctx->pending, ctx->pending_length);
+    reglex_slab_release(ctx->pending, ctx->pending_class);
+  }
+  ctx->pending = pending;
+  ctx->pending_class = size_class;
+}
+
+// The input of a push are the pending bytes followed by the pushed data.
+// Positions are counted from the first pending byte.
+static reglex_push_ctx_t *reglex_push_ctx = NULL;
+static const char *reglex_push_data = NULL;
+static size_t reglex_push_data_length = 0;
+
+static int reglex_push_byte(reglex_push_ctx_t *ctx, size_t pos) {
+  if (pos < ctx->pending_length) {
+    return (unsigned char)ctx->pending[pos];
+  }
+  return (unsigned char)reglex_push_data[pos - ctx->pending_length];
+}
+
+// Runs the code action of the token from start to checkpoint on the push state
+// and returns the end of the lexem, which a trailing context may have moved
+static size_t reglex_push_emit(reglex_push_ctx_t *ctx, size_t start,
+                               size_t checkpoint) {
+  // The lexem must not be split between the pending bytes and the data
+  if (start < ctx->pending_length && checkpoint > ctx->pending_length) {
+    size_t n = checkpoint - ctx->pending_length;
+    reglex_push_reserve(ctx, ctx->pending_length + n);
+    memcpy(&ctx->pending[ctx->pending_length], reglex_push_data, n);
+    ctx->pending_length += n;
+    reglex_push_data += n;
+    reglex_push_data_length -= n;
+  }
+  if (checkpoint <= ctx->pending_length) {
+    reglex_input = ctx->pending;
+    reglex_input_offset = 0;
+  } else {
+    reglex_input = (char *)reglex_push_data;
+    reglex_input_offset = ctx->pending_length;
+  }
+
+  const reglex_push_parser_t *parser = &reglex_push_parsers[ctx->parser];
+  reglex_state_t *state = &reglex_push_state;
+  location_t loc = {.ln = ctx->ln, .col = ctx->col, .eol = ctx->eol};
+  state->lexem_start_loc = loc;
+  reglex_increment_loc(&state->lexem_start_loc,
+                       reglex_input[start - reglex_input_offset]);
+  state->token_parser_fn = parser->token_parser_fn;
+  state->checkpoint_tag = ctx->checkpoint_tag;
+  state->token_start = start;
+  state->checkpoint = checkpoint;
+  state->has_lexem = 0;
+  parser->reject_fn();
+
+  size_t end = state->checkpoint;
+  for (size_t pos = start; pos < end; pos++) {
+    reglex_increment_loc(&loc, reglex_input[pos - reglex_input_offset]);
+  }
+  ctx->ln = loc.ln;
+  ctx->col = loc.col;
+  ctx->eol = loc.eol;
+  ctx->parser = 0;
+  while (reglex_push_parsers[ctx->parser].token_parser_fn !=
+         state->token_parser_fn) {
+    ctx->parser++;
+  }
+  return end;
+}
+
+// Returns the state after the byte c or 0, if the dfa rejects it. With the
+// comb encoding, a state only has the entries, in which it differs from its
+// default state, so the lookup follows the defaults until an entry is found.
+static inline unsigned reglex_push_next(const reglex_push_parser_t *parser,
+                                        unsigned state, int c) {
+#if defined(REGLEX_PUSH_COMB)
+  int class = parser->classes[c];
+  while (state != 0 && parser->check[parser->base[state] + class] != state) {
+    state = parser->defaults[state];
+  }
+  return state == 0 ? 0 : parser->next[parser->base[state] + class];
+#elif defined(REGLEX_PUSH_EC)
+  return parser->next[state * parser->class_count + parser->classes[c]];
+#else
+  return parser->next[state][parser->fold ? parser->fold[c] : c];
+#endif
+}
+
+// Runs the dfa over the pushed data. The unfinished token at the end is kept
+// together with the dfa state, unless the input ends. Returns 1 if the input
+// cannot be parsed.
+static int reglex_push_run(reglex_push_ctx_t *ctx, char at_end) {
+  const reglex_push_parser_t *parser = &reglex_push_parsers[ctx->parser];
+  size_t length = ctx->pending_length + reglex_push_data_length;
+  size_t start = 0;
+  size_t pos = ctx->pending_length;
+  size_t checkpoint = ctx->checkpoint;
+  int tag = ctx->checkpoint_tag;
+  unsigned state = ctx->dfa_state;
+
+  while (1) {
+    char is_done = parser->first_match && tag != -1;
+    if (!is_done && pos < length) {
+      int c = reglex_push_byte(ctx, pos);
+      unsigned next = reglex_push_next(parser, state, c);
+      if (next != 0) {
+        state = next;
+        pos++;
+        if (parser->tags[state] != -1) {
+          tag = parser->tags[state];
+          checkpoint = pos;
+        }
+        continue;
+      }
+    } else if (!is_done && !at_end) {
+      break;
+    }
+    if (tag == -1) {
+      if (start == length) {
+        break;
+      }
+      REGLEX_PROBE(error, 0, start, ctx->ln, ctx->col);
+      return 1;
+    }
+
+    ctx->checkpoint_tag = tag;
+#ifdef REGLEX_PROFILE
+    reglex_push_state.pos = pos;
+#endif
+    start = reglex_push_emit(ctx, start, checkpoint);
+    parser = &reglex_push_parsers[ctx->parser];
+    pos = start;
+    tag = -1;
+    state = parser->start;
+    // Once the next token starts in the data, the pending bytes are dropped
+    if (ctx->pending_length > 0 && start >= ctx->pending_length) {
+      start -= ctx->pending_length;
+      pos -= ctx->pending_length;
+      length -= ctx->pending_length;
+      reglex_push_release(ctx);
+    }
+  }
+
+  if (start == length) {
+    reglex_push_release(ctx);
+  } else if (start < ctx->pending_length) {
+    size_t kept = ctx->pending_length - start;
+    memmove(ctx->pending, &ctx->pending[start], kept);
+    ctx->pending_length = kept;
+    reglex_push_reserve(ctx, kept + reglex_push_data_length);
+    memcpy(&ctx->pending[kept], reglex_push_data, reglex_push_data_length);
+    ctx->pending_length += reglex_push_data_length;
+  } else {
+    size_t offset = start - ctx->pending_length;
+    reglex_push_release(ctx);
+    reglex_push_reserve(ctx, reglex_push_data_length - offset);
+    memcpy(ctx->pending, &reglex_push_data[offset],
+           reglex_push_data_length - offset);
+    ctx->pending_length = reglex_push_data_length - offset;
+  }
+#ifdef REGLEX_PROFILE
+  if (ctx->pending_length > reglex_profile_peak_pending) {
+    reglex_profile_peak_pending = ctx->pending_length;
+  }
+#endif
+  ctx->dfa_state = state;
+  ctx->checkpoint = tag == -1 ? 0 : checkpoint - start;
+  ctx->checkpoint_tag = tag;
+  return 0;
+}
+
+static int reglex_push_call(reglex_push_ctx_t *ctx, const char *data,
+                            size_t length, char at_end) {
+  reglex_state_t *state = reglex_state;
+  char *input = reglex_input;
+  size_t input_offset = reglex_input_offset;
+  reglex_push_ctx_t *outer_ctx = reglex_push_ctx;
+  const char *outer_data = reglex_push_data;
+  size_t outer_data_length = reglex_push_data_length;
+
+  REGLEX_PROBE(push, ctx, length);
+  reglex_state = &reglex_push_state;
+  reglex_push_ctx = ctx;
+  reglex_push_data = data;
+  reglex_push_data_length = length;
+  int result = reglex_push_run(ctx, at_end);
+
+  reglex_state = state;
+  reglex_input = input;
+  reglex_input_offset = input_offset;
+  reglex_push_ctx = outer_ctx;
+  reglex_push_data = outer_data;
+  reglex_push_data_length = outer_data_length;
+  return result;
+}
+
+void reglex_push_init(reglex_push_ctx_t *ctx) {
+  memset(ctx, 0, sizeof(reglex_push_ctx_t));
+  ctx->checkpoint_tag = -1;
+  ctx->dfa_state = reglex_push_parsers[0].start;
+  ctx->ln = 1;
+}
+
+int reglex_push(reglex_push_ctx_t *ctx, const char *data, size_t length) {
+  return reglex_push_call(ctx, data, length, 0);
+}
+
+// Parses the pending bytes as the end of the input and releases them
+int reglex_push_end(reglex_push_ctx_t *ctx) {
+  int result = reglex_push_call(ctx, NULL, 0, 1);
+  reglex_push_release(ctx);
+  return result;
+}
+
+reglex_push_ctx_t *reglex_push_context() { return reglex_push_ctx; }
+size_t reglex_push_pool_size() { return reglex_slab_bytes; }
+
+// A serialized state is a header of little endian fields followed by the
+// pending bytes: version (1), fingerprint (4), parser (1), dfa state (2),
+// checkpoint tag (2), checkpoint (4), eol (1), ln (4), col (4) and the number
+// of pending bytes (4).
+#define REGLEX_STATE_VERSION 1
+#define REGLEX_STATE_HEADER_SIZE 27
+
+static char *reglex_put_field(char *buf, uint32_t value, int size) {
+  for (int i = 0; i < size; i++) {
+    buf[i] = (char)(value >> (8 * i));
+  }
+  return buf + size;
+}
+
+static const char *reglex_get_field(const char *buf, uint32_t *value,
+                                    int size) {
+  *value = 0;
+  for (int i = 0; i < size; i++) {
+    *value |= (uint32_t)(unsigned char)buf[i] << (8 * i);
+  }
+  return buf + size;
+}
+
+// Returns the size of the serialized state, which is only written, if it fits
+// into the buffer
+size_t reglex_serialize_state(const reglex_push_ctx_t *ctx, char *buf,
+                              size_t size) {
+  size_t length = REGLEX_STATE_HEADER_SIZE + ctx->pending_length;
+  if (length > size) {
+    return length;
+  }
+  buf = reglex_put_field(buf, REGLEX_STATE_VERSION, 1);
+  buf = reglex_put_field(buf, reglex_push_fingerprint, 4);
+  buf = reglex_put_field(buf, ctx->parser, 1);
+  buf = reglex_put_field(buf, ctx->dfa_state, 2);
+  buf = reglex_put_field(buf, (uint16_t)ctx->checkpoint_tag, 2);
+  buf = reglex_put_field(buf, ctx->checkpoint, 4);
+  buf = reglex_put_field(buf, ctx->eol, 1);
+  buf = reglex_put_field(buf, (uint32_t)ctx->ln, 4);
+  buf = reglex_put_field(buf, (uint32_t)ctx->col, 4);
+  buf = reglex_put_field(buf, ctx->pending_length, 4);
+  if (ctx->pending_length > 0) {
+    memcpy(buf, ctx->pending, ctx->pending_length);
+  }
+  return length;
+}
+
+// Replaces the state of an initialized context with a serialized state.
+// Returns 1, if the state is malformed or has been serialized by a lexer with
+// different tables.
+int reglex_deserialize_state(reglex_push_ctx_t *ctx, const char *buf,
+                             size_t size) {
+  uint32_t version, fingerprint, parser, dfa_state, checkpoint_tag, checkpoint,
+      eol, ln, col, pending_length;
+  if (size < REGLEX_STATE_HEADER_SIZE) {
+    return 1;
+  }
+  buf = reglex_get_field(buf, &version, 1);
+  buf = reglex_get_field(buf, &fingerprint, 4);
+  buf = reglex_get_field(buf, &parser, 1);
+  buf = reglex_get_field(buf, &dfa_state, 2);
+  buf = reglex_get_field(buf, &checkpoint_tag, 2);
+  buf = reglex_get_field(buf, &checkpoint, 4);
+  buf = reglex_get_field(buf, &eol, 1);
+  buf = reglex_get_field(buf, &ln, 4);
+  buf = reglex_get_field(buf, &col, 4);
+  buf = reglex_get_field(buf, &pending_length, 4);
+  size_t parser_count =
+      sizeof(reglex_push_parsers) / sizeof(reglex_push_parsers[0]);
+  if (version != REGLEX_STATE_VERSION ||
+      fingerprint != reglex_push_fingerprint || parser >= parser_count ||
+      dfa_state == 0 || dfa_state >= reglex_push_parsers[parser].states ||
+      (checkpoint_tag != UINT16_MAX &&
+       checkpoint_tag >= reglex_push_parsers[parser].tag_count) ||
+      checkpoint > pending_length ||
+      pending_length != size - REGLEX_STATE_HEADER_SIZE) {
+    return 1;
+  }
+
+  reglex_push_release(ctx);
+  reglex_push_init(ctx);
+  ctx->parser = parser;
+  ctx->dfa_state = dfa_state;
+  ctx->checkpoint_tag = (int16_t)checkpoint_tag;
+  ctx->checkpoint = checkpoint;
+  ctx->eol = eol;
+  ctx->ln = (int)ln;
+  ctx->col = (int)col;
+  if (pending_length > 0) {
+    reglex_push_reserve(ctx, pending_length);
+    memcpy(ctx->pending, buf, pending_length);
+    ctx->pending_length = pending_length;
+  }
+  return 0;
+}
+#endif
+
 #REGLEX_MAIN
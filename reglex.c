@@ -25,6 +25,13 @@
  * The following reglex instructions exist:
  *
  * emit_main
+ * case_insensitive
+ * first_match
+ * bit_parallel
+ * push
+ * profile
+ * probes
+ * freestanding
  *
  * The instructions are separated by whitespace.
  *
@@ -44,6 +51,37 @@
  * The regex describes the lexems, and the code action (everything between
  * the special brackets) can be any c code, an is transferred as-is into the
  * resulting c file. lexems and code actions are separated by whitespace.
+ *
+ * <regex> |
+ *
+ * A rule with the action | shares the code action of the next rule.
+ * Consecutive rules with the same code action are accepted with a single tag.
+ *
+ * <regex> / <trailing context> %{<code action>%}
+ *
+ * A token with a trailing context only matches, if it is followed by the
+ * trailing context. The trailing context is not part of the lexem and is
+ * parsed again as part of the next token.
+ *
+ * A new parser is started with a header of the following form:
+ *
+ * %{ NAME <parser options> %}
+ *
+ * The parser options are separated by whitespace. The following parser
+ * options exist:
+ *
+ * case_insensitive
+ * first_match
+ * bit_parallel
+ *
+ * The instructions case_insensitive, first_match and bit_parallel set the
+ * option for all parsers.
+ *
+ * Before the regexes are passed to the regex2c library, they are rewritten by
+ * reglex. A part of a regex can be matched case insensitive by wrapping it in
+ * (?i:<regex>). Bounded repetition of the preceding char, class, group or
+ * definition is written as {n}, {n,} or {n,m}. Braces containing anything else
+ * refer to a definition.
  */
 
 #include "regex2c/not_enough_cli/not_enough_cli.h"
@@ -56,24 +94,86 @@
 #include "regex2c/regex_parser.h"
 
 #include <err.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
 
 #include "lexer_template/lexer_template.c"
 
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAS_MALLINFO2 1
+#else
+#define HAS_MALLINFO2 0
+#endif
+
 #define INSTR_EMIT_MAIN 1
+#define INSTR_CASE_INSENSITIVE 2
+#define INSTR_FIRST_MATCH 4
+#define INSTR_BIT_PARALLEL 8
+#define INSTR_PUSH 16
+#define INSTR_PROFILE 32
+#define INSTR_PROBES 64
+#define INSTR_FREESTANDING 128
+
+// The encodings of the transition tables of the push mode, see -T
+#define TABLES_DENSE 0
+#define TABLES_EC 1
+#define TABLES_COMB 2
+#define TABLES_ENCODINGS 3
+// With the comb encoding, the default of a state is searched among the states
+// before it and the chains of defaults are kept short, so lookups stay fast
+#define COMB_CANDIDATES 64
+#define COMB_MAX_CHAIN 4
+
+#define PARSER_CASE_INSENSITIVE 1
+#define PARSER_FIRST_MATCH 2
+#define PARSER_BIT_PARALLEL 4
+
+#define REGEX_CASE_SENSITIVE 0
+#define REGEX_CASE_FOLD 1
+#define REGEX_CASE_EXPAND 2
+
+#define REGEX_MAX_GROUP_DEPTH 256
+#define REGEX_MAX_SOURCE_DEPTH 64
+#define REGEX_MAX_REPETITION 1000
+
+#define DEFAULT_MAX_DFA_STATES 10000
+#define BIT_PARALLEL_MAX_POSITIONS 512
+
+#define GEN_DEFAULT_MEAN_LENGTH 8
+#define GEN_MAX_CHOICES 256
+#define GEN_MAX_FAILURES 1000
+
+#define WORST_CASE_REPEATS 128
+
+#define PHASE_SPEC 0
+#define PHASE_NFA 1
+#define PHASE_DFA 2
+#define PHASE_MINIMIZE 3
+#define PHASE_C_CODE 4
+#define PHASE_BIT_PARALLEL 5
+#define PHASE_ANALYSIS 6
+#define PHASE_OUTPUT 7
+#define PHASES 8
 
 #define REGLEX_DECLARATIONS "#REGLEX_DECLARATIONS"
 #define REGLEX_PARSER_SWITCHING "#REGLEX_PARSER_SWITCHING"
 #define REGLEX_REJECT_FUNCTIONS "#REGLEX_REJECT_FUNCTIONS"
+#define REGLEX_NEXT_FUNCTIONS "#REGLEX_NEXT_FUNCTIONS"
 #define REGLEX_MAIN "#REGLEX_MAIN"
 
 typedef struct reg_def_list {
   struct reg_def_list *next;
   string_t name;
+  string_t text;
   ast_t ast;
 } reg_def_list_t;
 
@@ -82,8 +182,30 @@ typedef struct token_action_list {
   ast_t token;
   string_t action;
   int tag;
+  int group_tag;
+  int ln;
+  bool_t shares_action;
+  bool_t is_dead;
+  bool_t has_trailing_context;
+  ast_t head;
+  ast_t trail;
+  // The lengths of the head and the trail, -1 if their lexems vary in length
+  int head_length;
+  int trail_length;
 } token_action_list_t;
 
+// The position automaton of a parser for the bit-parallel simulation. Each
+// char transition of the nfa is a position, bitsets of positions are stored in
+// words of 64 bits.
+typedef struct position_automaton {
+  int size;
+  int words;
+  uint64_t *first;
+  uint64_t *chars;
+  uint64_t *follow;
+  int *tags;
+} position_automaton_t;
+
 typedef struct parser_spec {
   struct parser_spec *next;
   token_action_list_t *tal;
@@ -92,9 +214,44 @@ typedef struct parser_spec {
   string_t unique_name;
   bool_t is_default;
   bool_t is_named;
+  int options;
   int idx;
+  int lexer;
+  position_automaton_t *positions;
+  int push_start;
+  int push_states;
+  int first_rule;
+  int max_token_length;
+  int push_classes;
 } parser_spec_t;
 
+// The weight of a rule in the generated token mix and the mean length of its
+// generated lexems
+typedef struct gen_rule {
+  long weight;
+  long mean_length;
+} gen_rule_t;
+
+// An input family prefix cycle^n and the bytes read again by the lexer in it
+typedef struct worst_case {
+  string_t prefix;
+  string_t cycle;
+  long long rereads;
+  size_t length;
+  bool_t is_quadratic;
+} worst_case_t;
+
+typedef struct regex_source {
+  struct regex_source *next;
+  char *data;
+  size_t pos;
+} regex_source_t;
+
+typedef struct regex_group {
+  int case_mode;
+  size_t start;
+} regex_group_t;
+
 static int next_char = EOF;
 static int col = 0, ln = 1;
 static bool_t just_consumed_nl = 0;
@@ -112,11 +269,58 @@ static FILE *out_file = NULL;
 static reg_def_list_t *defs = NULL;
 
 static bool_t output_debug_info = 0;
+static bool_t lockstep = 0;
+static char *symbol_prefix = NULL;
+static int max_dfa_states = DEFAULT_MAX_DFA_STATES;
+static uint32_t push_fingerprint = 2166136261u;
+static int push_tables = TABLES_DENSE;
+static bool_t report_tables = 0;
+static const char *TABLES_NAMES[TABLES_ENCODINGS] = {"dense", "ec", "comb"};
+static int rule_count = 0;
+
+static long long gen_input_size = 0;
+static uint64_t gen_seed = 1;
+static char *gen_weights = NULL;
+static long long worst_case_size = 0;
+static FILE *gen_file = NULL;
+
+static bool_t print_timings = 0;
+static const char *PHASE_NAMES[PHASES] = {
+    "spec", "nfa", "dfa", "minimize", "c code", "bit-parallel", "analysis",
+    "output"};
+static double phase_ns[PHASES];
+static long long phase_heap[PHASES];
+static double lap_ns = 0;
+static long long lap_heap = 0;
+
+// The symbols of the generated code, which are visible to other files. All
+// other functions and variables of the lexer are static.
+static const char *PUBLIC_SYMBOLS[] = {
+    "parse",          "parse_token",     "parse_result",      "lexem",
+    "lexer",          "filename",        "ln",                "col",
+    "switch_parser",  "set_is",          "token_type",        "peek_token",
+    "consume_token",  "snapshot",        "release",           "restore",
+    "push_init",      "push",            "push_end",          "push_context",
+    "push_pool_size", "serialize_state", "deserialize_state", "profile_dump",
+    "profile_reset",  "set_input",       "set_memory",        NULL,
+};
+
+static bool_t in_regex = 0;
+static string_t regex_out = {.data = NULL, .length = 0};
+static size_t regex_out_pos = 0;
+static string_t regex_text = {.data = NULL, .length = 0};
+static regex_source_t *regex_sources = NULL;
+static int regex_source_depth = 0;
+static regex_group_t regex_groups[REGEX_MAX_GROUP_DEPTH];
+static int regex_group_depth = 0;
+static bool_t has_regex_atom = 0;
+static size_t regex_atom_start = 0;
 
 static void delete_reg_def_list(reg_def_list_t *list) {
   while (list != NULL) {
     reg_def_list_t *next = list->next;
     free(list->name.data);
+    free(list->text.data);
     delete_ast(list->ast);
     free(list);
     list = next;
@@ -127,6 +331,10 @@ static void delete_token_action_list(token_action_list_t *list) {
   while (list != NULL) {
     token_action_list_t *next = list->next;
     delete_ast(list->token);
+    if (list->has_trailing_context) {
+      delete_ast(list->head);
+      delete_ast(list->trail);
+    }
     free(list->action.data);
     free(list);
     list = next;
@@ -160,7 +368,7 @@ static int get_next_input_char() {
       return EOF;
     }
     int next = getc(fin);
-    if (next == EOF) {
+    if (next == EOF && !lockstep) {
       open_next_in_file();
       return get_next_input_char();
     }
@@ -176,10 +384,8 @@ static void undo_char(int c) {
   col--;
 }
 
-int peek_next() { return next_char; }
-
-int consume_next() {
-  int c = peek_next();
+static int consume_raw() {
+  int c = next_char;
   if (has_undo_char) {
     next_char = undo_char_;
     has_undo_char = 0;
@@ -202,6 +408,26 @@ int consume_next() {
   return c;
 }
 
+static void rewrite_regex_char();
+
+int peek_next() {
+  if (regex_out_pos < regex_out.length) {
+    return (unsigned char)regex_out.data[regex_out_pos];
+  }
+  return next_char;
+}
+
+int consume_next() {
+  if (regex_out_pos < regex_out.length) {
+    int c = (unsigned char)regex_out.data[regex_out_pos++];
+    if (regex_out_pos == regex_out.length && in_regex) {
+      rewrite_regex_char();
+    }
+    return c;
+  }
+  return consume_raw();
+}
+
 int reject(char *err, ...) {
   va_list args;
   va_start(args, err);
@@ -213,17 +439,22 @@ int reject(char *err, ...) {
   errx(EXIT_FAILURE, "%d:%d: %s", ln, col, errf);
 }
 
-ast_t *get_definition(char *name) {
+static reg_def_list_t *find_definition(const char *name) {
   reg_def_list_t *list = defs;
   while (list != NULL) {
     if (strcmp(name, list->name.data) == 0) {
-      return &list->ast;
+      return list;
     }
     list = list->next;
   }
   return NULL;
 }
 
+ast_t *get_definition(char *name) {
+  reg_def_list_t *def = find_definition(name);
+  return def == NULL ? NULL : &def->ast;
+}
+
 bool_t is_end(int c) {
   switch (c) {
   case EOF:
@@ -238,7 +469,367 @@ bool_t is_end(int c) {
   }
 }
 
-static void consume_c(bool_t expect_eof) {
+static int regex_src_peek() {
+  if (regex_sources != NULL) {
+    return (unsigned char)regex_sources->data[regex_sources->pos];
+  }
+  return next_char;
+}
+
+static int regex_src_consume() {
+  if (regex_sources == NULL) {
+    return consume_raw();
+  }
+  regex_source_t *src = regex_sources;
+  int c = (unsigned char)src->data[src->pos++];
+  if (src->data[src->pos] == '\0') {
+    regex_sources = src->next;
+    regex_source_depth--;
+    free(src->data);
+    free(src);
+  }
+  return c;
+}
+
+static bool_t regex_src_at_end() {
+  return regex_sources == NULL && is_end(next_char);
+}
+
+static void push_regex_source(char *data) {
+  if (regex_source_depth >= REGEX_MAX_SOURCE_DEPTH) {
+    reject("definitions are nested too deeply");
+  }
+  regex_source_t *src = malloc(sizeof(regex_source_t));
+  src->next = regex_sources;
+  src->data = data;
+  src->pos = 0;
+  regex_sources = src;
+  regex_source_depth++;
+}
+
+static void emit_regex_char(char c) {
+  append_char_to_str(&regex_out, c);
+  append_char_to_str(&regex_text, c);
+}
+
+static void emit_regex_literal(int c, int mode) {
+  switch (c) {
+  case 'a' ... 'z':
+    if (mode == REGEX_CASE_EXPAND) {
+      emit_regex_char('[');
+      emit_regex_char(c);
+      emit_regex_char(c - 'a' + 'A');
+      emit_regex_char(']');
+      return;
+    }
+    break;
+  case 'A' ... 'Z':
+    if (mode == REGEX_CASE_FOLD) {
+      emit_regex_char(c - 'A' + 'a');
+      return;
+    }
+    if (mode == REGEX_CASE_EXPAND) {
+      emit_regex_char('[');
+      emit_regex_char(c);
+      emit_regex_char(c - 'A' + 'a');
+      emit_regex_char(']');
+      return;
+    }
+    break;
+  }
+  emit_regex_char(c);
+}
+
+static void emit_case_image(int lo, int hi, int from, int to, int image) {
+  lo = lo < from ? from : lo;
+  hi = hi > to ? to : hi;
+  if (lo > hi) {
+    return;
+  }
+  emit_regex_char(lo - from + image);
+  if (hi > lo) {
+    emit_regex_char('-');
+    emit_regex_char(hi - from + image);
+  }
+}
+
+// Returns the char matched by a single char of a class, or -1 if it is an
+// escape sequence, whose value is not known to reglex
+static int rewrite_regex_class_char() {
+  if (regex_src_at_end()) {
+    reject("expected ']'");
+  }
+  int c = regex_src_consume();
+  emit_regex_char(c);
+  if (c != '\\') {
+    return c;
+  }
+  if (regex_src_at_end()) {
+    reject("expected character after '\\'");
+  }
+  c = regex_src_consume();
+  emit_regex_char(c);
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 'r':
+    return '\r';
+  case 't':
+    return '\t';
+  case 's':
+    return ' ';
+  default:
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+      return -1;
+    }
+    return c;
+  }
+}
+
+static void rewrite_regex_class(int mode) {
+  emit_regex_char(regex_src_consume());
+  if (regex_src_peek() == '^') {
+    emit_regex_char(regex_src_consume());
+  }
+  while (regex_src_peek() != ']') {
+    int lo = rewrite_regex_class_char();
+    int hi = lo;
+    if (regex_src_peek() == '-') {
+      emit_regex_char(regex_src_consume());
+      if (regex_src_peek() != ']') {
+        hi = rewrite_regex_class_char();
+      }
+    }
+    if (mode != REGEX_CASE_SENSITIVE && lo != -1 && hi != -1) {
+      emit_case_image(lo, hi, 'A', 'Z', 'a');
+      if (mode == REGEX_CASE_EXPAND) {
+        emit_case_image(lo, hi, 'a', 'z', 'A');
+      }
+    }
+  }
+  emit_regex_char(regex_src_consume());
+}
+
+static void rewrite_regex_group() {
+  int mode = regex_groups[regex_group_depth].case_mode;
+  regex_src_consume();
+  if (regex_src_peek() == '?') {
+    regex_src_consume();
+    if (regex_src_consume() != 'i' || regex_src_consume() != ':') {
+      reject("expected '(?i:'");
+    }
+    if (mode == REGEX_CASE_SENSITIVE) {
+      mode = REGEX_CASE_EXPAND;
+    }
+  }
+  if (regex_group_depth + 1 >= REGEX_MAX_GROUP_DEPTH) {
+    reject("groups are nested too deeply");
+  }
+  regex_group_t *group = &regex_groups[++regex_group_depth];
+  group->case_mode = mode;
+  group->start = regex_text.length;
+  emit_regex_char('(');
+}
+
+static string_t consume_braces() {
+  string_t content = create_string(NULL);
+  regex_src_consume();
+  while (regex_src_peek() != '}') {
+    if (regex_src_at_end()) {
+      reject("expected '}'");
+    }
+    append_char_to_str(&content, regex_src_consume());
+  }
+  regex_src_consume();
+  return content;
+}
+
+// Parses a bound of a repetition, which must not exceed the maximum
+static int parse_repetition_bound(const char *str, char **end) {
+  errno = 0;
+  long bound = strtol(str, end, 10);
+  if (errno == ERANGE || bound > REGEX_MAX_REPETITION) {
+    reject("repetition exceeds the maximum of %d", REGEX_MAX_REPETITION);
+  }
+  return bound;
+}
+
+// Parses "n", "n," or "n,m" (m is -1 if the repetition is unbounded)
+static bool_t parse_repetition(const char *str, int *min, int *max) {
+  char *end;
+  if (*str < '0' || *str > '9') {
+    return 0;
+  }
+  *min = parse_repetition_bound(str, &end);
+  if (*end == '\0') {
+    *max = *min;
+    return 1;
+  }
+  if (*end != ',') {
+    return 0;
+  }
+  str = end + 1;
+  if (*str == '\0') {
+    *max = -1;
+    return 1;
+  }
+  if (*str < '0' || *str > '9') {
+    return 0;
+  }
+  *max = parse_repetition_bound(str, &end);
+  return *end == '\0';
+}
+
+static void emit_regex_atom_copies(const char *atom, int count) {
+  for (int i = 0; i < count; i++) {
+    for (const char *c = atom; *c != '\0'; c++) {
+      emit_regex_char(*c);
+    }
+  }
+}
+
+// The atom has already been emitted once, so the repetition is expressed
+// relative to that copy: a{3,5} becomes aa(a(a)?)?, a{0,3} becomes a?(a(a)?)?
+// and a{2,} becomes aa+. This keeps the automaton linear in the bounds.
+static void rewrite_regex_repetition(int min, int max) {
+  if (!has_regex_atom) {
+    reject("nothing to repeat");
+  }
+  if (max == 0 || (max != -1 && max < min)) {
+    reject("invalid repetition {%d,%d}", min, max);
+  }
+  if (min > REGEX_MAX_REPETITION || max > REGEX_MAX_REPETITION) {
+    reject("repetition exceeds the maximum of %d", REGEX_MAX_REPETITION);
+  }
+  char *atom = strndup(&regex_text.data[regex_atom_start],
+                       regex_text.length - regex_atom_start);
+  if (min == 0) {
+    emit_regex_char(max == -1 ? '*' : '?');
+    min = 1;
+  } else {
+    emit_regex_atom_copies(atom, min - 1);
+    if (max == -1) {
+      emit_regex_char('+');
+    }
+  }
+  if (max != -1) {
+    for (int i = min; i < max; i++) {
+      emit_regex_char('(');
+      emit_regex_atom_copies(atom, 1);
+    }
+    for (int i = min; i < max; i++) {
+      emit_regex_char(')');
+      emit_regex_char('?');
+    }
+  }
+  free(atom);
+}
+
+// Returns 1 if the reference has been replaced by the text of the definition,
+// which still has to be rewritten
+static bool_t rewrite_regex_reference(string_t *name, int mode) {
+  // Case insensitive references cannot share the ast of the definition, so the
+  // definition is rewritten again
+  reg_def_list_t *def =
+      mode == REGEX_CASE_SENSITIVE ? NULL : find_definition(name->data);
+  if (def != NULL) {
+    char *data;
+    asprintf(&data, "(%s)", def->text.data);
+    push_regex_source(data);
+    return 1;
+  }
+  emit_regex_char('{');
+  for (size_t i = 0; i < name->length; i++) {
+    emit_regex_char(name->data[i]);
+  }
+  emit_regex_char('}');
+  return 0;
+}
+
+static void rewrite_regex_char() {
+  free(regex_out.data);
+  regex_out = create_string(NULL);
+  regex_out_pos = 0;
+  if (regex_src_at_end()) {
+    return;
+  }
+  int mode = regex_groups[regex_group_depth].case_mode;
+  size_t start = regex_text.length;
+  bool_t is_atom = 1;
+  int c = regex_src_peek();
+  switch (c) {
+  case '\\':
+    emit_regex_char(regex_src_consume());
+    if (regex_src_at_end()) {
+      reject("expected character after '\\'");
+    }
+    emit_regex_char(regex_src_consume());
+    break;
+  case '[':
+    rewrite_regex_class(mode);
+    break;
+  case '(':
+    rewrite_regex_group();
+    is_atom = 0;
+    break;
+  case ')':
+    if (regex_group_depth > 0) {
+      start = regex_groups[regex_group_depth--].start;
+    } else {
+      is_atom = 0;
+    }
+    emit_regex_char(regex_src_consume());
+    break;
+  case '{': {
+    string_t content = consume_braces();
+    int min, max;
+    bool_t rewrite_again = 0;
+    if (parse_repetition(content.data, &min, &max)) {
+      rewrite_regex_repetition(min, max);
+      is_atom = 0;
+    } else {
+      rewrite_again = rewrite_regex_reference(&content, mode);
+    }
+    free(content.data);
+    if (rewrite_again) {
+      rewrite_regex_char();
+      return;
+    }
+    break;
+  }
+  case '|':
+  case '*':
+  case '+':
+  case '?':
+    emit_regex_char(regex_src_consume());
+    is_atom = 0;
+    break;
+  default:
+    emit_regex_literal(regex_src_consume(), mode);
+    break;
+  }
+  has_regex_atom = is_atom;
+  regex_atom_start = start;
+}
+
+static ast_t consume_regex(int case_mode) {
+  free(regex_text.data);
+  regex_text = create_string(NULL);
+  regex_groups[0].case_mode = case_mode;
+  regex_group_depth = 0;
+  has_regex_atom = 0;
+  in_regex = 1;
+  rewrite_regex_char();
+  ast_t ast = consume_regex_expr();
+  if (regex_out_pos < regex_out.length || regex_sources != NULL) {
+    reject("unexpected character '%c' in regex", peek_next());
+  }
+  in_regex = 0;
+  return ast;
+}
+
+static void consume_c(bool_t expect_eof, FILE *fout) {
   while (1) {
     switch (peek_next()) {
     case EOF:
@@ -253,11 +844,11 @@ static void consume_c(bool_t expect_eof) {
         consume_next();
         return;
       } else {
-        fputc('%', out_file);
+        fputc('%', fout);
       }
       break;
     default:
-      fputc(consume_next(), out_file);
+      fputc(consume_next(), fout);
       break;
     }
   }
@@ -326,7 +917,23 @@ static bool_t next_is_parser_name() {
   return 0;
 }
 
-static bool_t try_consume_parser_name(string_t *name) {
+static int consume_parser_option() {
+  int option = 0;
+  string_t name = consume_name();
+  if (strcmp(name.data, "case_insensitive") == 0) {
+    option = PARSER_CASE_INSENSITIVE;
+  } else if (strcmp(name.data, "first_match") == 0) {
+    option = PARSER_FIRST_MATCH;
+  } else if (strcmp(name.data, "bit_parallel") == 0) {
+    option = PARSER_BIT_PARALLEL;
+  } else {
+    reject("invalid parser option '%s'", name.data);
+  }
+  free(name.data);
+  return option;
+}
+
+static bool_t try_consume_parser_name(string_t *name, int *options) {
   if (peek_next() == '%') {
     consume_next();
     if (peek_next() == '{') {
@@ -334,6 +941,10 @@ static bool_t try_consume_parser_name(string_t *name) {
       consume_whitespace();
       *name = consume_name();
       consume_whitespace();
+      while (peek_next() != '%' && peek_next() != EOF) {
+        *options |= consume_parser_option();
+        consume_whitespace();
+      }
       if (peek_next() != '%') {
         reject("expected '%}' after parser name");
       }
@@ -360,6 +971,20 @@ static int consume_instructions() {
     string_t name = consume_name();
     if (strcmp(name.data, "emit_main") == 0) {
       flags |= INSTR_EMIT_MAIN;
+    } else if (strcmp(name.data, "case_insensitive") == 0) {
+      flags |= INSTR_CASE_INSENSITIVE;
+    } else if (strcmp(name.data, "first_match") == 0) {
+      flags |= INSTR_FIRST_MATCH;
+    } else if (strcmp(name.data, "bit_parallel") == 0) {
+      flags |= INSTR_BIT_PARALLEL;
+    } else if (strcmp(name.data, "push") == 0) {
+      flags |= INSTR_PUSH;
+    } else if (strcmp(name.data, "profile") == 0) {
+      flags |= INSTR_PROFILE;
+    } else if (strcmp(name.data, "probes") == 0) {
+      flags |= INSTR_PROBES;
+    } else if (strcmp(name.data, "freestanding") == 0) {
+      flags |= INSTR_FREESTANDING;
     } else {
       reject("invalid instruction '%s'", name.data);
     }
@@ -382,19 +1007,33 @@ static void consume_reg_defs() {
     }
     string_t name = consume_name();
     consume_whitespace();
-    ast_t ast = consume_regex_expr();
+    ast_t ast = consume_regex(REGEX_CASE_SENSITIVE);
     if (output_debug_info) {
       fprintf(out_file, "\nAST of %s:\n", name.data);
       print_ast_indented(&ast, 1, out_file);
     }
     reg_def_list_t *new_def = malloc(sizeof(reg_def_list_t));
     new_def->name = name;
+    new_def->text = regex_text;
     new_def->ast = ast;
+    regex_text = create_string(NULL);
     new_def->next = defs;
     defs = new_def;
   }
 }
 
+static bool_t try_consume_trailing_context_separator() {
+  if (peek_next() != '/') {
+    return 0;
+  }
+  consume_next();
+  if (!next_is_whitespace()) {
+    reject("expected whitespace after trailing context separator '/'");
+  }
+  consume_whitespace();
+  return 1;
+}
+
 static string_t consume_action() {
   if (peek_next() != '%') {
     reject("expected action (starts with '%%{)");
@@ -427,32 +1066,63 @@ static string_t consume_action() {
 }
 
 static bool_t consume_token_actions(token_action_list_t **list, string_t *name,
-                                    bool_t *found_name) {
+                                    bool_t *found_name, int *options) {
   int tag_ctr = 0;
   *found_name = 0;
   *list = NULL;
 
   consume_whitespace();
-  if (try_consume_parser_name(name)) {
+  if (try_consume_parser_name(name, options)) {
     *found_name = 1;
   }
+  int case_mode = *options & PARSER_CASE_INSENSITIVE ? REGEX_CASE_FOLD
+                                                      : REGEX_CASE_SENSITIVE;
 
   while (1) {
     consume_whitespace();
-    if (try_consume_delimiter()) {
-      return 0;
-    }
-    if (next_is_parser_name()) {
-      return 1;
+    bool_t is_last_parser = try_consume_delimiter();
+    if (is_last_parser || next_is_parser_name()) {
+      if (*list != NULL && (*list)->shares_action) {
+        reject("expected a rule after '|'");
+      }
+      return !is_last_parser;
     }
-    ast_t token = consume_regex_expr();
-    consume_whitespace();
-    string_t action = consume_action();
     token_action_list_t *new_action = malloc(sizeof(token_action_list_t));
+    new_action->ln = ln;
+    new_action->shares_action = 0;
+    new_action->is_dead = 0;
+    new_action->has_trailing_context = 0;
+    new_action->head_length = -1;
+    new_action->trail_length = -1;
+    ast_t token = consume_regex(case_mode);
+    consume_whitespace();
+    if (try_consume_trailing_context_separator()) {
+      // The token matches head and trail, the trail is given back afterwards
+      char *head_text = strdup(regex_text.data);
+      new_action->head = token;
+      new_action->trail = consume_regex(case_mode);
+      new_action->has_trailing_context = 1;
+      char *text;
+      asprintf(&text, "(%s)(%s)", head_text, regex_text.data);
+      push_regex_source(text);
+      token = consume_regex(REGEX_CASE_SENSITIVE);
+      free(head_text);
+      consume_whitespace();
+    }
+    // A rule with the action '|' shares the action of the next rule
+    string_t action;
+    if (peek_next() == '|') {
+      consume_next();
+      action = create_string(NULL);
+      new_action->shares_action = 1;
+    } else {
+      action = consume_action();
+    }
     new_action->token = token;
     new_action->next = *list;
     new_action->action = action;
     new_action->tag = tag_ctr++;
+    new_action->group_tag = new_action->tag;
     *list = new_action;
   }
 }
@@ -469,9 +1139,215 @@ static ast_list_t *to_ast_list(token_action_list_t *token_actions) {
   return ast_list;
 }
 
-static string_t get_unique_default_name(parser_spec_t *specs) {
+// Compares the actions without the whitespace around them
+static bool_t is_same_action(const string_t *a, const string_t *b) {
+  const char *a_start = a->data, *b_start = b->data;
+  size_t a_length = a->length, b_length = b->length;
+  while (a_length > 0 && is_end(*a_start)) {
+    a_start++;
+    a_length--;
+  }
+  while (a_length > 0 && is_end(a_start[a_length - 1])) {
+    a_length--;
+  }
+  while (b_length > 0 && is_end(*b_start)) {
+    b_start++;
+    b_length--;
+  }
+  while (b_length > 0 && is_end(b_start[b_length - 1])) {
+    b_length--;
+  }
+  return a_length == b_length && memcmp(a_start, b_start, a_length) == 0;
+}
+
+// Consecutive rules with the same action are accepted with the tag of the
+// first of them, which shrinks the dfa and the reject switch. Only consecutive
+// rules are merged, so the order of the tags, which decides between rules
+// matching the same lexem, does not change. Rules with a trailing context keep
+// their tags, since their lexems are split by their own state-machines.
+static void merge_rule_tags(parser_spec_t *spec, automaton_t *nfa) {
+  int count = spec->tal == NULL ? 0 : spec->tal->tag + 1;
+  token_action_list_t **rules = malloc((count > 0 ? count : 1) *
+                                       sizeof(token_action_list_t *));
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    rules[tal->tag] = tal;
+  }
+  for (int tag = count - 2; tag >= 0; tag--) {
+    if (rules[tag]->shares_action) {
+      free(rules[tag]->action.data);
+      rules[tag]->action = create_string(rules[tag + 1]->action.data);
+    }
+  }
+  for (int tag = 1; tag < count; tag++) {
+    token_action_list_t *prev = rules[tag - 1];
+    if (!prev->has_trailing_context && !rules[tag]->has_trailing_context &&
+        is_same_action(&prev->action, &rules[tag]->action)) {
+      rules[tag]->group_tag = prev->group_tag;
+    }
+  }
+  for (int i = 0; i < nfa->size; i++) {
+    if (nfa->nodes[i].end_tag != -1) {
+      nfa->nodes[i].end_tag = rules[nfa->nodes[i].end_tag]->group_tag;
+    }
+  }
+  free(rules);
+}
+
+// A rule, whose tag no reachable state of the dfa accepts, never wins against
+// the other rules: with longest match, the rules before it match all its
+// lexems, with first match, the parser always stops in an accepting state of
+// another rule before. It is dropped with a warning, so neither its action nor
+// its trailing context matchers are printed. With longest match, the minimal
+// dfa does not depend on the rule, since it does not change the tag of any
+// lexem. With first match, the transitions leaving the accepting states are
+// never taken, they are removed with the states only reachable through them,
+// so that minimize() can drop the structure of the dead rules.
+static void drop_dead_rules(parser_spec_t *spec, automaton_t *dfa) {
+  int count = spec->tal == NULL ? 0 : spec->tal->tag + 1;
+  if (count == 0) {
+    return;
+  }
+  bool_t is_first_match = (spec->options & PARSER_FIRST_MATCH) != 0;
+  bool_t *is_live = calloc(count, sizeof(bool_t));
+  bool_t *is_seen = calloc(dfa->size, sizeof(bool_t));
+  int *queue = malloc(dfa->size * sizeof(int));
+  int head = 0, tail = 0;
+  queue[tail++] = dfa->start_index;
+  is_seen[dfa->start_index] = 1;
+  while (head < tail) {
+    node_t *node = &dfa->nodes[queue[head++]];
+    if (node->end_tag != -1) {
+      is_live[node->end_tag] = 1;
+      if (is_first_match) {
+        continue;
+      }
+    }
+    for (transition_t *t = node->transitions; t != NULL; t = t->next) {
+      if (!is_seen[t->target]) {
+        is_seen[t->target] = 1;
+        queue[tail++] = t->target;
+      }
+    }
+  }
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (!is_live[tal->group_tag]) {
+      tal->is_dead = 1;
+      warnx("%d: the rule never matches in parser '%s', since other rules "
+            "always win over it, it is dropped",
+            tal->ln, spec->unique_name.data);
+    }
+  }
+  for (int i = 0; is_first_match && i < dfa->size; i++) {
+    node_t *node = &dfa->nodes[i];
+    if (is_seen[i] && node->end_tag == -1) {
+      continue;
+    }
+    if (!is_seen[i]) {
+      node->end_tag = -1;
+    }
+    while (node->transitions != NULL) {
+      transition_t *t = node->transitions;
+      node->transitions = t->next;
+      free(t);
+    }
+  }
+  free(is_live);
+  free(is_seen);
+  free(queue);
+}
+
+static int longest_read_from(automaton_t *dfa, int i, const bool_t *is_live,
+                             bool_t is_first_match, char *color,
+                             int *longest) {
+  if (color[i] == 1) {
+    return -1;
+  }
+  if (color[i] == 2) {
+    return longest[i];
+  }
+  color[i] = 1;
+  int max = 0;
+  node_t *node = &dfa->nodes[i];
+  if (!is_first_match || node->end_tag == -1) {
+    for (transition_t *t = node->transitions; t != NULL; t = t->next) {
+      if (t->epsilon || !is_live[t->target]) {
+        continue;
+      }
+      int n = longest_read_from(dfa, t->target, is_live, is_first_match, color,
+                                longest);
+      if (n == -1) {
+        return -1;
+      }
+      if (n + 1 > max) {
+        max = n + 1;
+      }
+    }
+  }
+  color[i] = 2;
+  longest[i] = max;
+  return max;
+}
+
+// Returns the most characters, which the dfa consumes for a token, or -1 if a
+// cycle makes it unbounded. Only the states, from which an accepting state can
+// be reached, are walked, since the lexer rejects the input in the others.
+static int longest_token(parser_spec_t *spec, automaton_t *dfa) {
+  bool_t is_first_match = (spec->options & PARSER_FIRST_MATCH) != 0;
+  // The transitions are reversed, to find the states, which reach acceptance
+  int *first = calloc(dfa->size + 1, sizeof(int));
+  for (int i = 0; i < dfa->size; i++) {
+    for (transition_t *t = dfa->nodes[i].transitions; t != NULL; t = t->next) {
+      first[t->target + 1]++;
+    }
+  }
+  for (int i = 0; i < dfa->size; i++) {
+    first[i + 1] += first[i];
+  }
+  int *sources = malloc((first[dfa->size] + 1) * sizeof(int));
+  int *fill = malloc(dfa->size * sizeof(int));
+  memcpy(fill, first, dfa->size * sizeof(int));
+  for (int i = 0; i < dfa->size; i++) {
+    for (transition_t *t = dfa->nodes[i].transitions; t != NULL; t = t->next) {
+      sources[fill[t->target]++] = i;
+    }
+  }
+
+  bool_t *is_live = calloc(dfa->size, sizeof(bool_t));
+  int *queue = malloc(dfa->size * sizeof(int));
+  int head = 0, tail = 0;
+  for (int i = 0; i < dfa->size; i++) {
+    if (dfa->nodes[i].end_tag != -1) {
+      is_live[i] = 1;
+      queue[tail++] = i;
+    }
+  }
+  while (head < tail) {
+    int i = queue[head++];
+    for (int j = first[i]; j < first[i + 1]; j++) {
+      if (!is_live[sources[j]]) {
+        is_live[sources[j]] = 1;
+        queue[tail++] = sources[j];
+      }
+    }
+  }
+
+  char *color = calloc(dfa->size, sizeof(char));
+  int *longest = malloc(dfa->size * sizeof(int));
+  int length = longest_read_from(dfa, dfa->start_index, is_live,
+                                 is_first_match, color, longest);
+  free(first);
+  free(sources);
+  free(fill);
+  free(is_live);
+  free(queue);
+  free(color);
+  free(longest);
+  return length;
+}
+
+static string_t get_unique_default_name(parser_spec_t *specs, int lexer) {
   while (specs != NULL) {
-    if (specs->is_default) {
+    if (specs->is_default && specs->lexer == lexer) {
       return specs->unique_name;
     }
     specs = specs->next;
@@ -480,62 +1356,1588 @@ static string_t get_unique_default_name(parser_spec_t *specs) {
        "internal error: parser specs do not contain a default spec");
 }
 
-static void print_parser_switching(parser_spec_t *specs) {
+static void print_initial_states(parser_spec_t *specs, int lexer_count,
+                                 const char *declaration) {
+  fprintf(out_file, "%s[REGLEX_LEXERS] = {\n", declaration);
+  for (int lexer = 0; lexer < lexer_count; lexer++) {
+    fprintf(out_file, "    REGLEX_INITIAL_STATE(reglex_parse_token_%s),\n",
+            get_unique_default_name(specs, lexer).data);
+  }
+  fprintf(out_file, "};\n");
+}
+
+static void print_parser_switching(parser_spec_t *specs, int lexer_count,
+                                   int flags) {
   bool_t is_first = 1;
-  fprintf(out_file,
-          "static void (*reglex_token_parser_fn)() = reglex_parse_token_%s;\n",
-          get_unique_default_name(specs).data);
+  print_initial_states(specs, lexer_count,
+                       "static reglex_state_t reglex_states");
+  // A freestanding lexer resets its states, whenever it gets a new input
+  if (flags & INSTR_FREESTANDING) {
+    print_initial_states(specs, lexer_count,
+                         "static const reglex_state_t reglex_initial_states");
+  }
   fprintf(out_file, "void reglex_switch_parser(const char *parser_name) {\n");
+  if (flags & INSTR_PROBES) {
+    fprintf(out_file, "  REGLEX_PROBE(switch_parser, parser_name);\n");
+  }
   while (specs != NULL) {
     if (specs->is_named) {
+      // Parsers of different lexers may have the same name
+      char *lexer_cond = NULL;
+      if (lexer_count > 1) {
+        asprintf(&lexer_cond, "reglex_state == &reglex_states[%d] && ",
+                 specs->lexer);
+      }
       fprintf(out_file,
-              " %s (strcmp(parser_name, \"%s\") == 0) {\n"
-              "    reglex_token_parser_fn = reglex_parse_token_%s;\n"
+              " %s (%s%s(parser_name, \"%s\") == 0) {\n"
+              "    reglex_state->token_parser_fn = reglex_parse_token_%s;\n"
               "  }",
-              is_first ? " if" : "else if", specs->name.data,
+              is_first ? " if" : "else if",
+              lexer_cond == NULL ? "" : lexer_cond,
+              flags & INSTR_FREESTANDING ? "reglex_strcmp" : "strcmp",
+              specs->name.data,
               specs->unique_name.data);
+      free(lexer_cond);
+      is_first = 0;
     }
     specs = specs->next;
-    is_first = 0;
   }
   fprintf(out_file, "}\n");
 }
 
-static void print_token_actions(token_action_list_t *token_actions) {
-  while (token_actions != NULL) {
-    fprintf(out_file, "  case %d:\n", token_actions->tag);
-    fprintf(out_file, "    %s\n", token_actions->action.data);
-    fprintf(out_file, "    break;\n");
-    token_actions = token_actions->next;
+static char *next_fn_name(parser_spec_t *spec) {
+  bool_t is_folded = (spec->options & PARSER_CASE_INSENSITIVE) != 0;
+  if (spec->options & PARSER_FIRST_MATCH) {
+    return is_folded ? "reglex_next_first_folded" : "reglex_next_first";
   }
+  return is_folded ? "reglex_next_folded" : "reglex_next";
 }
 
-static void print_token_actions_list_debug_info(token_action_list_t *tal) {
-  while (tal != NULL) {
-    fprintf(out_file, "  Tag: '%d'\n", tal->tag);
-    fprintf(out_file, "  Action: '%s'\n", tal->action.data);
-    fprintf(out_file, "  AST:\n");
-    print_ast_indented(&tal->token, 3, out_file);
-    tal = tal->next;
+static char *trailing_next_fn_name(parser_spec_t *spec) {
+  if (spec->options & PARSER_CASE_INSENSITIVE) {
+    return "reglex_trailing_next_folded";
   }
+  return "reglex_trailing_next";
 }
 
-static void print_reject_functions(parser_spec_t *specs) {
-  while (specs != NULL) {
-    fprintf(out_file,
-            "void reglex_reject_%s() {\n  switch (reglex_checkpoint_tag) {\n",
-            specs->unique_name.data);
-    print_token_actions(specs->tal);
-    fprintf(out_file, "  default:\n"
-                      "    if (reglex_read_ahead.length == 0) {\n"
-                      "      reglex_parse_result = 0;\n"
-                      "    } else {\n"
-                      "      reglex_parse_result = 1;\n"
-                      "    }\n"
-                      "    break;\n"
-                      "  }\n"
-                      "  reglex_reset_to_checkpoint();\n"
-                      "}\n");
+static bool_t has_trailing_context(parser_spec_t *spec) {
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (tal->has_trailing_context && !tal->is_dead) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Only rules, whose head and trail both vary in length, need matchers to split
+// their lexems
+static bool_t needs_trailing_matchers(token_action_list_t *tal) {
+  return tal->has_trailing_context && !tal->is_dead && tal->head_length == -1 &&
+         tal->trail_length == -1;
+}
+
+static bool_t has_trailing_matchers(parser_spec_t *spec) {
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (needs_trailing_matchers(tal)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Returns the length of all lexems accepted by the minimal dfa, or -1 if they
+// vary in length. The lexems have the same length, if every state, from which
+// an accepting state can be reached, has a single distance from the start.
+static int fixed_length(automaton_t *mdfa) {
+  bool_t *is_live = calloc(mdfa->size, sizeof(bool_t));
+  for (int i = 0; i < mdfa->size; i++) {
+    is_live[i] = mdfa->nodes[i].end_tag != -1;
+  }
+  bool_t is_changed = 1;
+  while (is_changed) {
+    is_changed = 0;
+    for (int i = 0; i < mdfa->size; i++) {
+      transition_t *t = mdfa->nodes[i].transitions;
+      for (; t != NULL && !is_live[i]; t = t->next) {
+        if (is_live[t->target]) {
+          is_live[i] = 1;
+          is_changed = 1;
+        }
+      }
+    }
+  }
+
+  int *depth = malloc(mdfa->size * sizeof(int));
+  int *queue = malloc(mdfa->size * sizeof(int));
+  for (int i = 0; i < mdfa->size; i++) {
+    depth[i] = -1;
+  }
+  int head = 0, tail = 0;
+  int length = -1;
+  if (is_live[mdfa->start_index]) {
+    depth[mdfa->start_index] = 0;
+    queue[tail++] = mdfa->start_index;
+  }
+  bool_t is_fixed = 1;
+  while (head < tail && is_fixed) {
+    int i = queue[head++];
+    if (mdfa->nodes[i].end_tag != -1) {
+      is_fixed = length == -1 || length == depth[i];
+      length = depth[i];
+    }
+    for (transition_t *t = mdfa->nodes[i].transitions; t != NULL;
+         t = t->next) {
+      if (!is_live[t->target]) {
+        continue;
+      }
+      if (depth[t->target] == -1) {
+        depth[t->target] = depth[i] + 1;
+        queue[tail++] = t->target;
+      } else if (depth[t->target] != depth[i] + 1) {
+        is_fixed = 0;
+      }
+    }
+  }
+  free(is_live);
+  free(depth);
+  free(queue);
+  return is_fixed ? length : -1;
+}
+
+static automaton_t trailing_context_dfa(token_action_list_t *tal,
+                                        bool_t is_head) {
+  ast_list_t ast_list = {.next = NULL,
+                         .ast = is_head ? &tal->head : &tal->trail};
+  automaton_t automaton = convert_ast_list_to_automaton(&ast_list);
+  automaton_t dfa = determinize(&automaton);
+  automaton_t mdfa = minimize(&dfa);
+  delete_automaton(automaton);
+  delete_automaton(dfa);
+  return mdfa;
+}
+
+static void print_trailing_context_matcher(parser_spec_t *spec,
+                                           token_action_list_t *tal,
+                                           automaton_t mdfa, bool_t is_head) {
+  char *fn_name;
+  asprintf(&fn_name, "reglex_trailing_%s_%s_%d", is_head ? "head" : "tail",
+           spec->unique_name.data, tal->tag);
+  print_automaton_to_c_code(mdfa, fn_name, trailing_next_fn_name(spec),
+                            "reglex_trailing_accept", "reglex_trailing_reject",
+                            REGEX2C_ALL_DECL_STATIC, out_file);
+  free(fn_name);
+}
+
+// As in flex, a head or a trail of a fixed length tells where the lexem is
+// split without scanning it again. Only the other rules get matchers.
+static void print_trailing_context_matchers(parser_spec_t *spec) {
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (!tal->has_trailing_context || tal->is_dead) {
+      continue;
+    }
+    automaton_t head = trailing_context_dfa(tal, 1);
+    if (head.nodes[head.start_index].end_tag != -1) {
+      errx(EXIT_FAILURE,
+           "%d: the regex before a trailing context may not accept an empty "
+           "string",
+           tal->ln);
+    }
+    automaton_t trail = trailing_context_dfa(tal, 0);
+    tal->head_length = fixed_length(&head);
+    tal->trail_length = fixed_length(&trail);
+    if (needs_trailing_matchers(tal)) {
+      print_trailing_context_matcher(spec, tal, head, 1);
+      print_trailing_context_matcher(spec, tal, trail, 0);
+    }
+    delete_automaton(head);
+    delete_automaton(trail);
+  }
+}
+
+static void set_bit(uint64_t *set, int i) {
+  set[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+static bool_t has_bit(const uint64_t *set, int i) {
+  return (set[i / 64] >> (i % 64)) & 1;
+}
+
+// Computes the epsilon closure of each node of the nfa as a bitset of nodes
+static uint64_t *nfa_closures(automaton_t *nfa, int words) {
+  uint64_t *closures = calloc((size_t)nfa->size * words, sizeof(uint64_t));
+  int *stack = malloc(nfa->size * sizeof(int));
+  for (int i = 0; i < nfa->size; i++) {
+    uint64_t *closure = &closures[(size_t)i * words];
+    int top = 0;
+    set_bit(closure, i);
+    stack[top++] = i;
+    while (top > 0) {
+      int node = stack[--top];
+      for (transition_t *t = nfa->nodes[node].transitions; t != NULL;
+           t = t->next) {
+        if (t->epsilon && !has_bit(closure, t->target)) {
+          set_bit(closure, t->target);
+          stack[top++] = t->target;
+        }
+      }
+    }
+  }
+  free(stack);
+  return closures;
+}
+
+static uint64_t hash_bitset(const uint64_t *set, int words) {
+  uint64_t hash = 14695981039346656037u;
+  for (int i = 0; i < words; i++) {
+    hash = (hash ^ set[i]) * 1099511628211u;
+  }
+  return hash;
+}
+
+// Runs the subset construction without building the dfa, to find out whether
+// determinize would create more than max_dfa_states states
+static bool_t dfa_fits(automaton_t *nfa, const uint64_t *closures, int words) {
+  bool_t is_boundary[257] = {[0] = 1};
+  for (int i = 0; i < nfa->size; i++) {
+    for (transition_t *t = nfa->nodes[i].transitions; t != NULL;
+         t = t->next) {
+      if (!t->epsilon) {
+        is_boundary[t->min] = 1;
+        is_boundary[t->max + 1] = 1;
+      }
+    }
+  }
+
+  int table_size = 2 * max_dfa_states + 1;
+  int *table = malloc(table_size * sizeof(int));
+  memset(table, -1, table_size * sizeof(int));
+  uint64_t *states = malloc((size_t)(max_dfa_states + 1) * words * 8);
+  memcpy(states, &closures[(size_t)nfa->start_index * words], words * 8);
+  table[hash_bitset(states, words) % table_size] = 0;
+  int count = 1;
+  bool_t fits = 1;
+
+  for (int state = 0; state < count && fits; state++) {
+    for (int c = 0; c < 256 && fits; c++) {
+      if (!is_boundary[c]) {
+        continue;
+      }
+      uint64_t *set = &states[(size_t)state * words];
+      uint64_t *target = &states[(size_t)count * words];
+      memset(target, 0, words * 8);
+      bool_t any = 0;
+      for (int i = 0; i < nfa->size; i++) {
+        if (!has_bit(set, i)) {
+          continue;
+        }
+        for (transition_t *t = nfa->nodes[i].transitions; t != NULL;
+             t = t->next) {
+          if (!t->epsilon && t->min <= c && c <= t->max) {
+            const uint64_t *closure = &closures[(size_t)t->target * words];
+            for (int w = 0; w < words; w++) {
+              target[w] |= closure[w];
+            }
+            any = 1;
+          }
+        }
+      }
+      if (!any) {
+        continue;
+      }
+      int slot = hash_bitset(target, words) % table_size;
+      while (table[slot] != -1 &&
+             memcmp(&states[(size_t)table[slot] * words], target,
+                    words * 8) != 0) {
+        slot = (slot + 1) % table_size;
+      }
+      if (table[slot] != -1) {
+        continue;
+      }
+      if (count == max_dfa_states) {
+        fits = 0;
+      } else {
+        table[slot] = count++;
+      }
+    }
+  }
+
+  free(table);
+  free(states);
+  return fits;
+}
+
+static bool_t nfa_accepts_empty(automaton_t *nfa, const uint64_t *closures,
+                                int words) {
+  const uint64_t *closure = &closures[(size_t)nfa->start_index * words];
+  for (int i = 0; i < nfa->size; i++) {
+    if (has_bit(closure, i) && nfa->nodes[i].end_tag != -1) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int count_positions(automaton_t *nfa) {
+  int size = 0;
+  for (int i = 0; i < nfa->size; i++) {
+    for (transition_t *t = nfa->nodes[i].transitions; t != NULL;
+         t = t->next) {
+      size += !t->epsilon;
+    }
+  }
+  return size;
+}
+
+// Builds the position automaton of the nfa: a position follows another, if
+// its transition starts in the closure of the other's target. A position
+// accepts the highest priority tag in the closure of its target.
+static position_automaton_t *build_position_automaton(automaton_t *nfa,
+                                                      const uint64_t *closures,
+                                                      int node_words) {
+  position_automaton_t *pa = malloc(sizeof(position_automaton_t));
+  pa->size = count_positions(nfa);
+  pa->words = pa->size == 0 ? 1 : (pa->size + 63) / 64;
+  int words = pa->words;
+  pa->first = calloc(words, sizeof(uint64_t));
+  pa->chars = calloc(256 * words, sizeof(uint64_t));
+  pa->follow = calloc((size_t)pa->size * words, sizeof(uint64_t));
+  pa->tags = malloc(pa->size * sizeof(int));
+
+  transition_t **transitions = malloc(pa->size * sizeof(transition_t *));
+  int *sources = malloc(pa->size * sizeof(int));
+  int p = 0;
+  for (int i = 0; i < nfa->size; i++) {
+    for (transition_t *t = nfa->nodes[i].transitions; t != NULL;
+         t = t->next) {
+      if (!t->epsilon) {
+        transitions[p] = t;
+        sources[p++] = i;
+      }
+    }
+  }
+
+  const uint64_t *start = &closures[(size_t)nfa->start_index * node_words];
+  for (p = 0; p < pa->size; p++) {
+    if (has_bit(start, sources[p])) {
+      set_bit(pa->first, p);
+    }
+    for (int c = transitions[p]->min; c <= transitions[p]->max; c++) {
+      set_bit(&pa->chars[c * words], p);
+    }
+    const uint64_t *closure =
+        &closures[(size_t)transitions[p]->target * node_words];
+    for (int q = 0; q < pa->size; q++) {
+      if (has_bit(closure, sources[q])) {
+        set_bit(&pa->follow[(size_t)p * words], q);
+      }
+    }
+    pa->tags[p] = -1;
+    for (int i = 0; i < nfa->size; i++) {
+      int tag = nfa->nodes[i].end_tag;
+      if (has_bit(closure, i) && tag != -1 &&
+          (pa->tags[p] == -1 || tag < pa->tags[p])) {
+        pa->tags[p] = tag;
+      }
+    }
+  }
+
+  free(transitions);
+  free(sources);
+  return pa;
+}
+
+static void delete_position_automaton(position_automaton_t *pa) {
+  if (pa != NULL) {
+    free(pa->first);
+    free(pa->chars);
+    free(pa->follow);
+    free(pa->tags);
+    free(pa);
+  }
+}
+
+// Chooses the bit-parallel simulation, if it is forced or if the dfa would
+// grow too large
+static bool_t use_bit_parallel(parser_spec_t *spec, automaton_t *nfa,
+                               const uint64_t *closures, int words) {
+  bool_t is_forced = (spec->options & PARSER_BIT_PARALLEL) != 0;
+  if (!is_forced && dfa_fits(nfa, closures, words)) {
+    return 0;
+  }
+  int positions = count_positions(nfa);
+  if (positions <= BIT_PARALLEL_MAX_POSITIONS) {
+    return 1;
+  }
+  if (is_forced) {
+    errx(EXIT_FAILURE,
+         "parser '%s' has %d positions, the bit-parallel simulation supports "
+         "at most %d",
+         spec->unique_name.data, positions, BIT_PARALLEL_MAX_POSITIONS);
+  }
+  warnx("the dfa of parser '%s' exceeds %d states, but the parser has too "
+        "many positions (%d) for the bit-parallel simulation",
+        spec->unique_name.data, max_dfa_states, positions);
+  return 0;
+}
+
+static void print_words(const uint64_t *data, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    fprintf(out_file, "%s0x%016llxu,", i % 4 == 0 ? "\n    " : " ",
+            (unsigned long long)data[i]);
+  }
+  fprintf(out_file, "\n};\n");
+}
+
+// The follow table is indexed by groups of four positions. Each entry holds
+// the positions following any of the active positions in the group.
+static void print_bit_parallel_parser(parser_spec_t *spec) {
+  position_automaton_t *pa = spec->positions;
+  const char *name = spec->unique_name.data;
+  int words = pa->words;
+  int groups = words * 16;
+
+  uint64_t *follow = calloc((size_t)groups * 16 * words, sizeof(uint64_t));
+  for (int group = 0; group < groups; group++) {
+    for (int bits = 0; bits < 16; bits++) {
+      uint64_t *entry = &follow[((size_t)group * 16 + bits) * words];
+      for (int i = 0; i < 4; i++) {
+        int p = group * 4 + i;
+        if ((bits >> i & 1) && p < pa->size) {
+          for (int w = 0; w < words; w++) {
+            entry[w] |= pa->follow[(size_t)p * words + w];
+          }
+        }
+      }
+    }
+  }
+
+  // Tags in order of priority, each with the mask of its accepting positions
+  int max_tag = -1;
+  for (int p = 0; p < pa->size; p++) {
+    max_tag = pa->tags[p] > max_tag ? pa->tags[p] : max_tag;
+  }
+  uint64_t *accept = calloc((size_t)(max_tag + 2) * words, sizeof(uint64_t));
+  uint64_t *accept_any = calloc(words, sizeof(uint64_t));
+  int *tags = malloc((max_tag + 2) * sizeof(int));
+  int tag_count = 0;
+  for (int tag = 0; tag <= max_tag; tag++) {
+    bool_t any = 0;
+    for (int p = 0; p < pa->size; p++) {
+      if (pa->tags[p] == tag) {
+        set_bit(&accept[(size_t)tag_count * words], p);
+        set_bit(accept_any, p);
+        any = 1;
+      }
+    }
+    if (any) {
+      tags[tag_count++] = tag;
+    }
+  }
+
+  fprintf(out_file, "static const uint64_t reglex_bp_%s_first[] = {", name);
+  print_words(pa->first, words);
+  fprintf(out_file, "static const uint64_t reglex_bp_%s_chars[] = {", name);
+  print_words(pa->chars, 256 * words);
+  fprintf(out_file, "static const uint64_t reglex_bp_%s_follow[] = {", name);
+  print_words(follow, (size_t)groups * 16 * words);
+  fprintf(out_file, "static const uint64_t reglex_bp_%s_accept[] = {", name);
+  print_words(accept, (size_t)(tag_count > 0 ? tag_count : 1) * words);
+  fprintf(out_file, "static const uint64_t reglex_bp_%s_accept_any[] = {",
+          name);
+  print_words(accept_any, words);
+  fprintf(out_file, "static const int reglex_bp_%s_tags[] = {", name);
+  for (int i = 0; i < tag_count; i++) {
+    fprintf(out_file, "%s%d", i == 0 ? "" : ", ", tags[i]);
+  }
+  fprintf(out_file, "%s};\n", tag_count == 0 ? "-1" : "");
+  fprintf(out_file,
+          "static const reglex_bp_t reglex_bp_%s = {\n"
+          "    %d, %d, reglex_bp_%s_first, reglex_bp_%s_chars,\n"
+          "    reglex_bp_%s_follow, reglex_bp_%s_accept, "
+          "reglex_bp_%s_accept_any,\n"
+          "    reglex_bp_%s_tags};\n",
+          name, words, tag_count, name, name, name, name, name, name);
+  fprintf(out_file,
+          "static void reglex_parse_token_%s() {\n"
+          "  reglex_bp_run(&reglex_bp_%s, %s, reglex_reject_%s);\n"
+          "}\n",
+          name, name, next_fn_name(spec), name);
+
+  free(follow);
+  free(accept);
+  free(accept_any);
+  free(tags);
+}
+
+static void print_bit_parallel_parsers(parser_spec_t *specs) {
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    if (spec->positions != NULL) {
+      print_bit_parallel_parser(spec);
+    }
+  }
+}
+
+// The transition tables of a parser packed as a comb: the entries, in which a
+// state differs from its default state, are placed at the first base, at which
+// they do not collide with those of the other states. The check of an entry is
+// the state it belongs to.
+typedef struct comb_table {
+  unsigned *base;
+  unsigned short *defaults;
+  unsigned short *check;
+  unsigned short *next;
+  size_t length;
+} comb_table_t;
+
+static int fold_byte(int c, bool_t is_folded) {
+  return is_folded && c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Fills the classes of the bytes, which no state tells apart, and returns
+// their count. Case insensitive parsers see the folded byte.
+static int push_byte_classes(const unsigned short *rows, int states,
+                             bool_t is_folded, unsigned char *classes) {
+  uint64_t hashes[256];
+  for (int c = 0; c < 256; c++) {
+    hashes[c] = 14695981039346656037u;
+    for (int s = 0; s < states; s++) {
+      hashes[c] = (hashes[c] ^ rows[s * 256 + fold_byte(c, is_folded)]) *
+                  1099511628211u;
+    }
+  }
+  int first[256];
+  int count = 0;
+  for (int c = 0; c < 256; c++) {
+    int k = 0;
+    for (; k < count; k++) {
+      int a = fold_byte(first[k], is_folded), b = fold_byte(c, is_folded);
+      if (hashes[first[k]] != hashes[c]) {
+        continue;
+      }
+      int s = 0;
+      while (s < states && rows[s * 256 + a] == rows[s * 256 + b]) {
+        s++;
+      }
+      if (s == states) {
+        break;
+      }
+    }
+    if (k == count) {
+      first[count++] = c;
+    }
+    classes[c] = k;
+  }
+  return count;
+}
+
+static comb_table_t build_comb_table(const unsigned short *rows, int states,
+                                     int count) {
+  comb_table_t comb;
+  size_t capacity = (size_t)states * count + count;
+  comb.base = calloc(states, sizeof(unsigned));
+  comb.defaults = calloc(states, sizeof(unsigned short));
+  comb.check = calloc(capacity, sizeof(unsigned short));
+  comb.next = calloc(capacity, sizeof(unsigned short));
+  comb.length = count;
+  int *chain = calloc(states, sizeof(int));
+  int *entries = malloc(count * sizeof(int));
+  size_t first_free = 0;
+  // The dead state 0 has no entries, its lookups never reach the table
+  for (int s = 1; s < states; s++) {
+    const unsigned short *row = &rows[s * count];
+    int best = 0;
+    int best_entries = 0;
+    for (int k = 0; k < count; k++) {
+      best_entries += row[k] != 0;
+    }
+    for (int d = s - 1; d > 0 && d >= s - COMB_CANDIDATES; d--) {
+      if (chain[d] >= COMB_MAX_CHAIN) {
+        continue;
+      }
+      int differences = 0;
+      for (int k = 0; k < count && differences < best_entries; k++) {
+        differences += row[k] != rows[d * count + k];
+      }
+      if (differences < best_entries) {
+        best = d;
+        best_entries = differences;
+      }
+    }
+    comb.defaults[s] = best;
+    chain[s] = best == 0 ? 0 : chain[best] + 1;
+
+    int n = 0;
+    for (int k = 0; k < count; k++) {
+      if (row[k] != rows[best * count + k]) {
+        entries[n++] = k;
+      }
+    }
+    if (n == 0) {
+      continue;
+    }
+    while (first_free < capacity && comb.check[first_free] != 0) {
+      first_free++;
+    }
+    size_t base = first_free > entries[0] ? first_free - entries[0] : 0;
+    while (1) {
+      int i = 0;
+      while (i < n && comb.check[base + entries[i]] == 0) {
+        i++;
+      }
+      if (i == n) {
+        break;
+      }
+      base++;
+    }
+    comb.base[s] = base;
+    for (int i = 0; i < n; i++) {
+      comb.check[base + entries[i]] = s;
+      comb.next[base + entries[i]] = row[entries[i]];
+    }
+    if (base + count > comb.length) {
+      comb.length = base + count;
+    }
+  }
+  free(chain);
+  free(entries);
+  return comb;
+}
+
+// Prints a table of count values of size bytes
+static void print_push_table(const char *type, const char *name,
+                             const char *table, const void *values,
+                             size_t count, int size) {
+  fprintf(out_file, "static const %s reglex_push_%s_%s[] = {", type, name,
+          table);
+  for (size_t i = 0; i < count; i++) {
+    unsigned value = size == 1   ? ((const unsigned char *)values)[i]
+                     : size == 2 ? ((const unsigned short *)values)[i]
+                                 : ((const unsigned *)values)[i];
+    fprintf(out_file, "%s%u,", i % 16 == 0 ? "\n    " : " ", value);
+  }
+  fprintf(out_file, "\n};\n");
+}
+
+// Prints the dfa as a dense transition table for push mode. State 0 is the
+// dead state, the states of the dfa follow. The tables are hashed into the
+// fingerprint, which serialized states are checked against.
+// With -T, the table is encoded with byte classes or packed as a comb.
+static void print_push_tables(parser_spec_t *spec, automaton_t *mdfa) {
+  const char *name = spec->unique_name.data;
+  if (mdfa->size >= UINT16_MAX) {
+    errx(EXIT_FAILURE,
+         "the dfa of parser '%s' has too many states for push mode", name);
+  }
+  spec->push_start = mdfa->start_index + 1;
+  spec->push_states = mdfa->size + 1;
+  int states = spec->push_states;
+  bool_t is_folded = (spec->options & PARSER_CASE_INSENSITIVE) != 0;
+
+  // The dense rows, the dead state 0 comes first
+  unsigned short *rows = calloc((size_t)states * 256, sizeof(unsigned short));
+  for (int i = 0; i < mdfa->size; i++) {
+    unsigned short *row = &rows[(i + 1) * 256];
+    for (transition_t *t = mdfa->nodes[i].transitions; t != NULL;
+         t = t->next) {
+      for (int c = t->min; !t->epsilon && c <= t->max; c++) {
+        row[c] = t->target + 1;
+      }
+    }
+    for (int c = 0; c < 256; c++) {
+      push_fingerprint = (push_fingerprint ^ row[c]) * 16777619u;
+    }
+  }
+
+  unsigned char classes[256];
+  int count = push_byte_classes(rows, states, is_folded, classes);
+  spec->push_classes = count;
+  unsigned short *class_rows =
+      malloc((size_t)states * count * sizeof(unsigned short));
+  for (int s = 0; s < states; s++) {
+    for (int c = 0; c < 256; c++) {
+      class_rows[s * count + classes[c]] =
+          rows[s * 256 + fold_byte(c, is_folded)];
+    }
+  }
+  comb_table_t comb = build_comb_table(class_rows, states, count);
+
+  size_t bytes[TABLES_ENCODINGS];
+  bytes[TABLES_DENSE] = (size_t)states * 256 * sizeof(unsigned short);
+  bytes[TABLES_EC] = 256 + (size_t)states * count * sizeof(unsigned short);
+  bytes[TABLES_COMB] = 256 + states * (sizeof(unsigned) + 2) +
+                       comb.length * 2 * sizeof(unsigned short);
+  fprintf(out_file,
+          "// Parser '%s': %d states, %d byte classes, tables of %zu bytes "
+          "dense, %zu ec, %zu comb\n",
+          name, states, count, bytes[TABLES_DENSE], bytes[TABLES_EC],
+          bytes[TABLES_COMB]);
+  if (report_tables) {
+    fprintf(stderr,
+            "parser '%s': %d states, %d byte classes, tables of %zu bytes "
+            "dense, %zu ec, %zu comb, %s is used\n",
+            name, states, count, bytes[TABLES_DENSE], bytes[TABLES_EC],
+            bytes[TABLES_COMB], TABLES_NAMES[push_tables]);
+  }
+
+  switch (push_tables) {
+  case TABLES_DENSE:
+    fprintf(out_file,
+            "static const unsigned short reglex_push_%s_next[][256] = {\n",
+            name);
+    for (int s = 0; s < states; s++) {
+      fprintf(out_file, "    {");
+      for (int c = 0; c < 256 && s > 0; c++) {
+        fprintf(out_file, "%s%d,", c % 16 == 0 ? "\n        " : " ",
+                rows[s * 256 + c]);
+      }
+      fprintf(out_file, s == 0 ? "0},\n" : "\n    },\n");
+    }
+    fprintf(out_file, "};\n");
+    break;
+  case TABLES_EC:
+    print_push_table("unsigned char", name, "classes", classes, 256, 1);
+    print_push_table("unsigned short", name, "next", class_rows,
+                     (size_t)states * count, 2);
+    break;
+  case TABLES_COMB:
+    print_push_table("unsigned char", name, "classes", classes, 256, 1);
+    print_push_table("unsigned", name, "base", comb.base, states, 4);
+    print_push_table("unsigned short", name, "defaults", comb.defaults, states,
+                     2);
+    print_push_table("unsigned short", name, "check", comb.check, comb.length,
+                     2);
+    print_push_table("unsigned short", name, "next", comb.next, comb.length,
+                     2);
+    break;
+  }
+  free(rows);
+  free(class_rows);
+  free(comb.base);
+  free(comb.defaults);
+  free(comb.check);
+  free(comb.next);
+
+  fprintf(out_file, "static const short reglex_push_%s_tags[] = {-1", name);
+  for (int i = 0; i < mdfa->size; i++) {
+    fprintf(out_file, ", %d", mdfa->nodes[i].end_tag);
+    push_fingerprint = (push_fingerprint ^ mdfa->nodes[i].end_tag) * 16777619u;
+  }
+  fprintf(out_file, "};\n");
+}
+
+// The default parser comes first, so that new push contexts start with it
+static void print_push_parsers(parser_spec_t *specs) {
+  int count = 0;
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    count++;
+  }
+  fprintf(out_file,
+          "static const reglex_push_parser_t reglex_push_parsers[] = {\n");
+  for (int idx = 0; idx < count; idx++) {
+    for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+      if (spec->idx != idx) {
+        continue;
+      }
+      const char *name = spec->unique_name.data;
+      fprintf(out_file, "    {reglex_parse_token_%s, reglex_reject_%s,\n     ",
+              name, name);
+      switch (push_tables) {
+      case TABLES_DENSE:
+        fprintf(out_file, "reglex_push_%s_next, ", name);
+        break;
+      case TABLES_EC:
+        fprintf(out_file,
+                "reglex_push_%s_classes, reglex_push_%s_next, %d,\n     ",
+                name, name, spec->push_classes);
+        break;
+      case TABLES_COMB:
+        fprintf(out_file,
+                "reglex_push_%s_classes, reglex_push_%s_base,\n"
+                "     reglex_push_%s_defaults, reglex_push_%s_check,\n"
+                "     reglex_push_%s_next, ",
+                name, name, name, name, name);
+        break;
+      }
+      bool_t is_folded = push_tables == TABLES_DENSE &&
+                         (spec->options & PARSER_CASE_INSENSITIVE);
+      int tag_count = spec->tal == NULL ? 0 : spec->tal->tag + 1;
+      fprintf(out_file, "reglex_push_%s_tags, %d, %d, %d, %s,\n     %d},\n",
+              name, spec->push_start, spec->push_states, tag_count,
+              is_folded ? "reglex_case_fold" : "NULL",
+              (spec->options & PARSER_FIRST_MATCH) != 0);
+    }
+  }
+  fprintf(out_file, "};\n");
+  fprintf(out_file,
+          "static const uint32_t reglex_push_fingerprint = 0x%08xu;\n",
+          push_fingerprint);
+}
+
+// The random generator of the input generation (splitmix64), seeded with -S
+static uint64_t gen_next_random() {
+  uint64_t z = (gen_seed += 0x9e3779b97f4a7c15u);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9u;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebu;
+  return z ^ (z >> 31);
+}
+
+static int gen_random_below(int n) { return gen_next_random() % n; }
+
+// Parses the weights of the rules "W[:L],..." in the order of the spec, where
+// W is the weight of the rule in the token mix and L the mean length of its
+// lexems. Rules without an entry have the weight 1 and the mean length 8.
+static void parse_gen_weights(gen_rule_t *rules, int count) {
+  for (int tag = 0; tag < count; tag++) {
+    rules[tag].weight = 1;
+    rules[tag].mean_length = GEN_DEFAULT_MEAN_LENGTH;
+  }
+  const char *str = gen_weights;
+  for (int tag = 0; str != NULL && *str != '\0'; tag++) {
+    char *end;
+    long weight = strtol(str, &end, 10);
+    long mean_length = GEN_DEFAULT_MEAN_LENGTH;
+    if (end == str || weight < 0) {
+      errx(EXIT_FAILURE, "Invalid weights \"%s\"\n", gen_weights);
+    }
+    if (*end == ':') {
+      str = end + 1;
+      mean_length = strtol(str, &end, 10);
+      if (end == str || mean_length < 0) {
+        errx(EXIT_FAILURE, "Invalid weights \"%s\"\n", gen_weights);
+      }
+    }
+    if (*end != ',' && *end != '\0') {
+      errx(EXIT_FAILURE, "Invalid weights \"%s\"\n", gen_weights);
+    }
+    if (tag < count) {
+      rules[tag].weight = weight;
+      rules[tag].mean_length = mean_length;
+    }
+    str = *end == ',' ? end + 1 : end;
+  }
+}
+
+static int dfa_step(automaton_t *dfa, int state, int c) {
+  for (transition_t *t = dfa->nodes[state].transitions; t != NULL;
+       t = t->next) {
+    if (!t->epsilon && t->min <= c && c <= t->max) {
+      return t->target;
+    }
+  }
+  return -1;
+}
+
+// Computes the length of the shortest path from each state to a state, which
+// accepts the tag (-1 if there is none). A first match parser stops at the
+// first accepting state, so the paths may not pass any accepting state.
+static int *gen_distances(automaton_t *dfa, int tag, bool_t is_first_match) {
+  int *dist = malloc(dfa->size * sizeof(int));
+  for (int i = 0; i < dfa->size; i++) {
+    dist[i] = dfa->nodes[i].end_tag == tag ? 0 : -1;
+  }
+  bool_t changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int i = 0; i < dfa->size; i++) {
+      if (dist[i] == 0 || (is_first_match && dfa->nodes[i].end_tag != -1)) {
+        continue;
+      }
+      for (transition_t *t = dfa->nodes[i].transitions; t != NULL;
+           t = t->next) {
+        int d = dist[t->target];
+        if (!t->epsilon && d != -1 && (dist[i] == -1 || d + 1 < dist[i])) {
+          dist[i] = d + 1;
+          changed = 1;
+        }
+      }
+    }
+  }
+  return dist;
+}
+
+// Prefers printable chars, so the generated input stays readable
+static int gen_char(transition_t *t) {
+  int lo = t->min < ' ' ? ' ' : t->min;
+  int hi = t->max > '~' ? '~' : t->max;
+  if (lo > hi) {
+    if (t->min <= '\n' && '\n' <= t->max) {
+      return '\n';
+    }
+    lo = t->min;
+    hi = t->max;
+  }
+  return lo + gen_random_below(hi - lo + 1);
+}
+
+// Walks randomly from the start state to a state, which accepts the tag. The
+// walk wanders until it has reached a length drawn from a geometric
+// distribution, then it takes the shortest path to an accepting state. A
+// first match parser emits the token at the first accepting state.
+static void gen_walk(automaton_t *dfa, const int *dist, int mean_length,
+                     bool_t is_first_match, string_t *lexem) {
+  size_t length = 0;
+  while (gen_random_below(mean_length + 1) != 0) {
+    length++;
+  }
+  int state = dfa->start_index;
+  lexem->length = 0;
+  while (dist[state] != 0 || (!is_first_match && lexem->length < length)) {
+    transition_t *choices[GEN_MAX_CHOICES];
+    int count = 0;
+    for (transition_t *t = dfa->nodes[state].transitions;
+         t != NULL && count < GEN_MAX_CHOICES; t = t->next) {
+      int d = t->epsilon ? -1 : dist[t->target];
+      if (d != -1 && (lexem->length < length || d < dist[state])) {
+        choices[count++] = t;
+      }
+    }
+    if (count == 0) {
+      break;
+    }
+    transition_t *t = choices[gen_random_below(count)];
+    append_char_to_str(lexem, gen_char(t));
+    state = t->target;
+  }
+}
+
+// The scans of the tokens, which the dfa could still extend, continue over the
+// next token. If one of them reaches an accepting state, the lexer would
+// parse a longer token and the next token is rejected.
+static bool_t gen_continue_scans(automaton_t *dfa, int *scans, int *count,
+                                 const string_t *lexem) {
+  int *next = malloc((*count + 1) * sizeof(int));
+  int next_count = 0;
+  for (int i = 0; i < *count; i++) {
+    int state = scans[i];
+    for (size_t j = 0; j < lexem->length && state != -1; j++) {
+      state = dfa_step(dfa, state, (unsigned char)lexem->data[j]);
+      if (state != -1 && dfa->nodes[state].end_tag != -1) {
+        free(next);
+        return 0;
+      }
+    }
+    if (state != -1) {
+      next[next_count++] = state;
+    }
+  }
+  memcpy(scans, next, next_count * sizeof(int));
+  *count = next_count;
+  free(next);
+  return 1;
+}
+
+static void gen_add_scan(automaton_t *dfa, int *scans, int *count,
+                         const string_t *lexem) {
+  int state = dfa->start_index;
+  for (size_t i = 0; i < lexem->length && state != -1; i++) {
+    state = dfa_step(dfa, state, (unsigned char)lexem->data[i]);
+  }
+  if (state == -1 || dfa->nodes[state].transitions == NULL) {
+    return;
+  }
+  for (int i = 0; i < *count; i++) {
+    if (scans[i] == state) {
+      return;
+    }
+  }
+  scans[(*count)++] = state;
+}
+
+// Writes random tokens of the parser to the output, until it has the size
+// given with -g. The tokens are chosen by the weights of their rules and only
+// appended, if the lexer splits the input into the same tokens. Rules with a
+// trailing context are left out, since the trailing context is parsed again.
+static void generate_input(parser_spec_t *spec, automaton_t *dfa) {
+  int count = spec->tal == NULL ? 0 : spec->tal->tag + 1;
+  bool_t is_first_match = (spec->options & PARSER_FIRST_MATCH) != 0;
+  gen_rule_t *rules = malloc((count > 0 ? count : 1) * sizeof(gen_rule_t));
+  parse_gen_weights(rules, count);
+  // The lexems of merged rules are generated from the first rule of the group
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (tal->group_tag != tal->tag) {
+      rules[tal->group_tag].weight += rules[tal->tag].weight;
+      rules[tal->tag].weight = 0;
+    }
+  }
+  int **dists = malloc((count > 0 ? count : 1) * sizeof(int *));
+  long total_weight = 0;
+  for (int tag = 0; tag < count; tag++) {
+    dists[tag] = gen_distances(dfa, tag, is_first_match);
+    if (dists[tag][dfa->start_index] == -1) {
+      rules[tag].weight = 0;
+    }
+  }
+  for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+    if (tal->has_trailing_context) {
+      rules[tal->tag].weight = 0;
+    }
+  }
+  for (int tag = 0; tag < count; tag++) {
+    total_weight += rules[tag].weight;
+  }
+  if (total_weight == 0) {
+    errx(EXIT_FAILURE, "parser '%s' has no rules to generate tokens from",
+         spec->unique_name.data);
+  }
+
+  int *scans = malloc(dfa->size * sizeof(int));
+  int scan_count = 0;
+  string_t lexem = create_string(NULL);
+  long long size = 0;
+  int failures = 0;
+  while (size < gen_input_size) {
+    long pick = gen_next_random() % total_weight;
+    int tag = 0;
+    while (pick >= rules[tag].weight) {
+      pick -= rules[tag].weight;
+      tag++;
+    }
+    gen_walk(dfa, dists[tag], rules[tag].mean_length, is_first_match,
+             &lexem);
+    // A first match parser never reads past the end of a token
+    if (!is_first_match) {
+      if (!gen_continue_scans(dfa, scans, &scan_count, &lexem)) {
+        if (++failures == GEN_MAX_FAILURES) {
+          errx(EXIT_FAILURE,
+               "cannot generate a token of parser '%s', which the lexer does "
+               "not merge with the previous tokens",
+               spec->unique_name.data);
+        }
+        continue;
+      }
+      gen_add_scan(dfa, scans, &scan_count, &lexem);
+    }
+    failures = 0;
+    fwrite(lexem.data, 1, lexem.length, gen_file);
+    size += lexem.length;
+  }
+
+  for (int tag = 0; tag < count; tag++) {
+    free(dists[tag]);
+  }
+  free(dists);
+  free(rules);
+  free(scans);
+  free(lexem.data);
+}
+
+// The char, by which a transition is represented in a worst case input
+static int representative_char(transition_t *t) {
+  int lo = t->min < ' ' ? ' ' : t->min;
+  return lo <= t->max && lo <= '~' ? lo : t->min;
+}
+
+// Finds the shortest path from the state to each state. Only states, which do
+// not accept a token, are passed, if is_rejecting is set. The path to a state
+// is given by the previous state and the char of the last transition.
+static void dfa_shortest_paths(automaton_t *dfa, int from, bool_t is_rejecting,
+                               int *prev, int *chars) {
+  int *queue = malloc(dfa->size * sizeof(int));
+  int head = 0, tail = 0;
+  for (int i = 0; i < dfa->size; i++) {
+    prev[i] = -1;
+  }
+  queue[tail++] = from;
+  while (head < tail) {
+    int state = queue[head++];
+    for (transition_t *t = dfa->nodes[state].transitions; t != NULL;
+         t = t->next) {
+      if (t->epsilon || prev[t->target] != -1) {
+        continue;
+      }
+      if (is_rejecting && dfa->nodes[t->target].end_tag != -1) {
+        continue;
+      }
+      prev[t->target] = state;
+      chars[t->target] = representative_char(t);
+      if (t->target != from) {
+        queue[tail++] = t->target;
+      }
+    }
+  }
+  free(queue);
+}
+
+// Appends the chars of the path from the start of the paths to the state. A
+// path to the start itself is the cycle back to it, if there is one.
+static void append_path(string_t *str, int from, int to, const int *prev,
+                        const int *chars) {
+  string_t reversed = create_string(NULL);
+  int state = to;
+  do {
+    if (prev[state] == -1) {
+      break;
+    }
+    append_char_to_str(&reversed, chars[state]);
+    state = prev[state];
+  } while (state != from);
+  for (size_t i = reversed.length; i > 0; i--) {
+    append_char_to_str(str, reversed.data[i - 1]);
+  }
+  free(reversed.data);
+}
+
+// Runs the lexer over the input and counts the bytes, which are read again
+// after each token, including the char, at which the dfa stops. The lexer
+// stops at the first char, which does not start a token.
+static long long count_rereads(automaton_t *dfa, bool_t is_first_match,
+                               const string_t *input) {
+  long long rereads = 0;
+  size_t start = 0;
+  while (start < input->length) {
+    int state = dfa->start_index;
+    size_t pos = start;
+    size_t checkpoint = start;
+    while (pos < input->length) {
+      state = dfa_step(dfa, state, (unsigned char)input->data[pos++]);
+      if (state == -1) {
+        break;
+      }
+      if (dfa->nodes[state].end_tag != -1) {
+        checkpoint = pos;
+        if (is_first_match) {
+          break;
+        }
+      }
+    }
+    if (checkpoint == start) {
+      break;
+    }
+    rereads += pos - checkpoint;
+    start = checkpoint;
+  }
+  return rereads;
+}
+
+static void append_string(string_t *str, const string_t *other) {
+  for (size_t i = 0; i < other->length; i++) {
+    append_char_to_str(str, other->data[i]);
+  }
+}
+
+// Builds the input prefix followed by count times cycle
+static void build_family(string_t *input, const worst_case_t *family,
+                         long long count) {
+  input->length = 0;
+  append_string(input, &family->prefix);
+  for (long long n = 0; n < count; n++) {
+    append_string(input, &family->cycle);
+  }
+}
+
+// Measures the rereads of the family at two sizes. If they grow by at least
+// three times, when the size doubles, the family is quadratic.
+static void measure_family(automaton_t *dfa, bool_t is_first_match,
+                           worst_case_t *family) {
+  string_t input = create_string(NULL);
+  build_family(&input, family, WORST_CASE_REPEATS);
+  long long rereads = count_rereads(dfa, is_first_match, &input);
+  build_family(&input, family, 2 * WORST_CASE_REPEATS);
+  family->rereads = count_rereads(dfa, is_first_match, &input);
+  family->length = input.length;
+  family->is_quadratic = family->rereads >= 3 * rereads && rereads > 0;
+  free(input.data);
+}
+
+static bool_t is_worse(const worst_case_t *family, const worst_case_t *worst) {
+  if (family->is_quadratic != worst->is_quadratic) {
+    return family->is_quadratic;
+  }
+  return family->rereads * (long long)worst->length >
+         worst->rereads * (long long)family->length;
+}
+
+static void print_escaped(FILE *fout, const string_t *str) {
+  for (size_t i = 0; i < str->length; i++) {
+    int c = (unsigned char)str->data[i];
+    if (c == '"' || c == '\\') {
+      fprintf(fout, "\\%c", c);
+    } else if (c >= ' ' && c <= '~') {
+      fputc(c, fout);
+    } else {
+      fprintf(fout, "\\x%02x", c);
+    }
+  }
+}
+
+// Searches the dfa of the parser for the input, which the lexer reads again
+// the most. Backtracking is caused by cycles through states, which do not
+// accept a token: the lexer runs through them after a token, until the dfa
+// stops. For each such cycle, the inputs p s^n, (p s)^n and s^n are measured,
+// where p is the shortest path to the cycle and s the cycle. The worst input
+// is reported and, for the first parser, written to the output.
+static void find_worst_case(parser_spec_t *spec, automaton_t *dfa,
+                            bool_t is_written) {
+  bool_t is_first_match = (spec->options & PARSER_FIRST_MATCH) != 0;
+  int *prev = malloc(dfa->size * sizeof(int));
+  int *chars = malloc(dfa->size * sizeof(int));
+  int *cycle_prev = malloc(dfa->size * sizeof(int));
+  int *cycle_chars = malloc(dfa->size * sizeof(int));
+  dfa_shortest_paths(dfa, dfa->start_index, 0, prev, chars);
+
+  worst_case_t worst = {.prefix = create_string(NULL),
+                        .cycle = create_string(NULL)};
+  for (int q = 0; q < dfa->size; q++) {
+    if (dfa->nodes[q].end_tag != -1 ||
+        (q != dfa->start_index && prev[q] == -1)) {
+      continue;
+    }
+    dfa_shortest_paths(dfa, q, 1, cycle_prev, cycle_chars);
+    if (cycle_prev[q] == -1) {
+      continue;
+    }
+    string_t path = create_string(NULL);
+    string_t cycle = create_string(NULL);
+    if (q != dfa->start_index) {
+      append_path(&path, dfa->start_index, q, prev, chars);
+    }
+    append_path(&cycle, q, q, cycle_prev, cycle_chars);
+
+    for (int form = 0; form < 3; form++) {
+      worst_case_t family = {.prefix = create_string(NULL),
+                             .cycle = create_string(NULL)};
+      if (form == 0) {
+        append_string(&family.prefix, &path);
+      }
+      if (form == 1) {
+        append_string(&family.cycle, &path);
+      }
+      append_string(&family.cycle, &cycle);
+      measure_family(dfa, is_first_match, &family);
+      if (worst.cycle.length == 0 || is_worse(&family, &worst)) {
+        free(worst.prefix.data);
+        free(worst.cycle.data);
+        worst = family;
+      } else {
+        free(family.prefix.data);
+        free(family.cycle.data);
+      }
+    }
+    free(path.data);
+    free(cycle.data);
+  }
+
+  if (worst.cycle.length == 0) {
+    fprintf(stderr,
+            "parser '%s': linear, the dfa has no cycle through states, which "
+            "do not accept a token, so the input read again per token is "
+            "bounded\n",
+            spec->unique_name.data);
+  } else if (worst.rereads == 0) {
+    fprintf(stderr, "parser '%s': linear, no input is read again\n",
+            spec->unique_name.data);
+  } else {
+    fprintf(stderr, "parser '%s': %s, \"", spec->unique_name.data,
+            worst.is_quadratic ? "quadratic" : "linear");
+    print_escaped(stderr, &worst.prefix);
+    fprintf(stderr, "\" \"");
+    print_escaped(stderr, &worst.cycle);
+    fprintf(stderr,
+            "\"^n is read again %lld times in %zu bytes (%.2f bytes per "
+            "byte)\n",
+            worst.rereads, worst.length,
+            (double)worst.rereads / worst.length);
+  }
+  if (is_written && worst.cycle.length > 0) {
+    string_t input = create_string(NULL);
+    long long count = (worst_case_size - (long long)worst.prefix.length +
+                       worst.cycle.length - 1) /
+                      worst.cycle.length;
+    build_family(&input, &worst, count > 0 ? count : 1);
+    fwrite(input.data, 1, input.length, gen_file);
+    free(input.data);
+  }
+
+  free(worst.prefix.data);
+  free(worst.cycle.data);
+  free(prev);
+  free(chars);
+  free(cycle_prev);
+  free(cycle_chars);
+}
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Only glibc 2.33 and later report the heap in use, otherwise the heap column
+// of the timings is left empty
+static long long heap_in_use() {
+#if HAS_MALLINFO2
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+// Adds the time and the heap growth since the last lap to the phase. The
+// phases of all parsers are summed up.
+static void lap(int phase) {
+  if (!print_timings) {
+    return;
+  }
+  double ns = now_ns();
+  long long heap = heap_in_use();
+  if (phase >= 0) {
+    phase_ns[phase] += ns - lap_ns;
+    phase_heap[phase] += heap - lap_heap;
+  }
+  lap_ns = ns;
+  lap_heap = heap;
+}
+
+static void print_phase_timings() {
+  double total_ns = 0;
+  long long total_heap = 0;
+  fprintf(stderr, "%-14s %12s %12s\n", "phase", "ms", "heap KiB");
+  for (int i = 0; i < PHASES; i++) {
+    if (HAS_MALLINFO2) {
+      fprintf(stderr, "%-14s %12.3f %12lld\n", PHASE_NAMES[i],
+              phase_ns[i] / 1e6, phase_heap[i] / 1024);
+    } else {
+      fprintf(stderr, "%-14s %12.3f %12s\n", PHASE_NAMES[i], phase_ns[i] / 1e6,
+              "-");
+    }
+    total_ns += phase_ns[i];
+    total_heap += phase_heap[i];
+  }
+  if (HAS_MALLINFO2) {
+    fprintf(stderr, "%-14s %12.3f %12lld\n", "total", total_ns / 1e6,
+            total_heap / 1024);
+  } else {
+    fprintf(stderr, "%-14s %12.3f %12s\n", "total", total_ns / 1e6, "-");
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(stderr, "%-14s %12s %12ld\n", "peak rss", "", usage.ru_maxrss);
+}
+
+// Renames the public symbols of the lexer, so that several lexers can be
+// linked into one program. The defines precede all code, so that the code
+// actions may keep using the reglex_ names.
+static void print_symbol_prefix() {
+  if (symbol_prefix == NULL) {
+    return;
+  }
+  for (const char **symbol = PUBLIC_SYMBOLS; *symbol != NULL; symbol++) {
+    fprintf(out_file, "#define reglex_%s %s_%s\n", *symbol, symbol_prefix,
+            *symbol);
+  }
+}
+
+static void print_declarations(parser_spec_t *specs, int lexer_count,
+                               int flags) {
+  if (lexer_count > 1) {
+    fprintf(out_file, "#define REGLEX_LEXERS %d\n", lexer_count);
+  }
+  bool_t any_trailing_context = 0;
+  bool_t any_trailing_matchers = 0;
+  bool_t any_bit_parallel = 0;
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    any_trailing_context |= has_trailing_context(spec);
+    any_trailing_matchers |= has_trailing_matchers(spec);
+    any_bit_parallel |= spec->positions != NULL;
+  }
+  if (any_trailing_context) {
+    fprintf(out_file, "#define REGLEX_TRAILING_CONTEXT\n");
+  }
+  if (any_trailing_matchers) {
+    fprintf(out_file, "#define REGLEX_TRAILING_MATCHERS\n");
+  }
+  if (any_bit_parallel) {
+    fprintf(out_file, "#define REGLEX_BIT_PARALLEL\n");
+  }
+  if (flags & INSTR_PUSH) {
+    fprintf(out_file, "#define REGLEX_PUSH\n");
+    if (push_tables == TABLES_EC) {
+      fprintf(out_file, "#define REGLEX_PUSH_EC\n");
+    } else if (push_tables == TABLES_COMB) {
+      fprintf(out_file, "#define REGLEX_PUSH_COMB\n");
+    }
+  }
+  if (flags & INSTR_PROFILE) {
+    fprintf(out_file, "#define REGLEX_PROFILE\n");
+    fprintf(out_file, "#define REGLEX_PROFILE_RULES %d\n",
+            rule_count > 0 ? rule_count : 1);
+  }
+  if (flags & INSTR_PROBES) {
+    fprintf(out_file, "#define REGLEX_PROBES\n");
+  }
+  if (flags & INSTR_FREESTANDING) {
+    fprintf(out_file, "#define REGLEX_FREESTANDING\n");
+  }
+  // With a bound on the length of the tokens, the buffers are fixed arrays
+  int max_token_length = 0;
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    if (spec->max_token_length == -1) {
+      fprintf(out_file, "// Parser '%s': the tokens are unbounded\n",
+              spec->unique_name.data);
+      max_token_length = -1;
+    } else {
+      fprintf(out_file, "// Parser '%s': the tokens are at most %d bytes\n",
+              spec->unique_name.data, spec->max_token_length);
+      if (max_token_length != -1 && spec->max_token_length > max_token_length) {
+        max_token_length = spec->max_token_length;
+      }
+    }
+  }
+  if (max_token_length != -1) {
+    fprintf(out_file, "#define REGLEX_MAX_TOKEN_LENGTH %d\n",
+            max_token_length);
+  }
+}
+
+static void print_next_functions(parser_spec_t *specs) {
+  bool_t any_folded = 0;
+  bool_t any_folded_trailing_context = 0;
+  bool_t any_first_match = 0;
+  bool_t any_folded_first_match = 0;
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    bool_t is_first_match = (spec->options & PARSER_FIRST_MATCH) != 0;
+    if (spec->options & PARSER_CASE_INSENSITIVE) {
+      any_folded = 1;
+      any_folded_trailing_context |= has_trailing_matchers(spec);
+      any_folded_first_match |= is_first_match;
+    } else {
+      any_first_match |= is_first_match;
+    }
+  }
+  if (any_folded) {
+    // Case insensitive parsers see every letter as its lower case equivalent
+    fprintf(out_file, "static const unsigned char reglex_case_fold[256] = {");
+    for (int c = 0; c < 256; c++) {
+      fprintf(out_file, "%s%d,", c % 16 == 0 ? "\n   " : " ",
+              c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+    fprintf(out_file,
+            "\n};\n"
+            "static int reglex_next_folded() {\n"
+            "  int c = reglex_next();\n"
+            "  return c == EOF ? EOF : reglex_case_fold[(unsigned char)c];\n"
+            "}\n");
+  }
+  if (any_folded_trailing_context) {
+    fprintf(out_file,
+            "static int reglex_trailing_next_folded() {\n"
+            "  int c = reglex_trailing_next();\n"
+            "  return c == EOF ? EOF : reglex_case_fold[(unsigned char)c];\n"
+            "}\n");
+  }
+  // First match parsers stop reading once a token has been accepted. The
+  // state-machine rejects the EOF and the token is emitted without
+  // backtracking.
+  if (any_first_match) {
+    fprintf(out_file, "static int reglex_next_first() {\n"
+                      "  return reglex_state->checkpoint_tag != -1 ? EOF : "
+                      "reglex_next();\n"
+                      "}\n");
+  }
+  if (any_folded_first_match) {
+    fprintf(out_file, "static int reglex_next_first_folded() {\n"
+                      "  return reglex_state->checkpoint_tag != -1 ? EOF : "
+                      "reglex_next_folded();\n"
+                      "}\n");
+  }
+}
+
+static void print_token_actions(token_action_list_t *token_actions,
+                                const char *unique_name) {
+  while (token_actions != NULL) {
+    // Merged rules are accepted with the tag of the first rule of the group
+    if (token_actions->group_tag != token_actions->tag ||
+        token_actions->is_dead) {
+      token_actions = token_actions->next;
+      continue;
+    }
+    fprintf(out_file, "  case %d:\n", token_actions->tag);
+    if (token_actions->has_trailing_context &&
+        token_actions->head_length != -1) {
+      fprintf(out_file, "    reglex_cut_lexem(%d);\n",
+              token_actions->head_length);
+    } else if (token_actions->has_trailing_context &&
+               token_actions->trail_length != -1) {
+      fprintf(out_file,
+              "    reglex_cut_lexem(reglex_state->checkpoint - "
+              "reglex_state->token_start - %d);\n",
+              token_actions->trail_length);
+    } else if (token_actions->has_trailing_context) {
+      fprintf(out_file,
+              "    reglex_split_lexem(reglex_trailing_head_%s_%d, "
+              "reglex_trailing_tail_%s_%d);\n",
+              unique_name, token_actions->tag, unique_name,
+              token_actions->tag);
+    }
+    fprintf(out_file, "    %s\n", token_actions->action.data);
+    fprintf(out_file, "    break;\n");
+    token_actions = token_actions->next;
+  }
+}
+
+static void print_token_actions_list_debug_info(token_action_list_t *tal) {
+  while (tal != NULL) {
+    fprintf(out_file, "  Tag: '%d'\n", tal->tag);
+    if (tal->group_tag != tal->tag) {
+      fprintf(out_file, "  Merged into tag: '%d'\n", tal->group_tag);
+    }
+    fprintf(out_file, "  Action: '%s'\n", tal->action.data);
+    fprintf(out_file, "  AST:\n");
+    print_ast_indented(&tal->token, 3, out_file);
+    tal = tal->next;
+  }
+}
+
+// The rules of all parsers are numbered in the order of the parsers, so the
+// profile can tell them apart
+static void print_profile_rules(parser_spec_t *specs) {
+  const char **parsers = calloc(rule_count, sizeof(const char *));
+  int *lexers = calloc(rule_count, sizeof(int));
+  int *lines = calloc(rule_count, sizeof(int));
+  for (parser_spec_t *spec = specs; spec != NULL; spec = spec->next) {
+    for (token_action_list_t *tal = spec->tal; tal != NULL; tal = tal->next) {
+      parsers[spec->first_rule + tal->tag] =
+          spec->is_named ? spec->name.data : "<default>";
+      lexers[spec->first_rule + tal->tag] = spec->lexer;
+      lines[spec->first_rule + tal->tag] = tal->ln;
+    }
+  }
+  fprintf(out_file,
+          "static const reglex_profile_rule_t reglex_profile_rules[] = {\n");
+  for (int i = 0; i < rule_count; i++) {
+    fprintf(out_file, "    {%d, \"%s\", %d},\n", lexers[i], parsers[i],
+            lines[i]);
+  }
+  fprintf(out_file, "%s};\n", rule_count == 0 ? "    {0, NULL, 0},\n" : "");
+  free(parsers);
+  free(lexers);
+  free(lines);
+}
+
+static void print_reject_functions(parser_spec_t *specs, int flags) {
+  bool_t is_profiled = (flags & INSTR_PROFILE) != 0;
+  if (is_profiled) {
+    print_profile_rules(specs);
+  }
+  while (specs != NULL) {
+    fprintf(out_file, "static void reglex_reject_%s() {\n",
+            specs->unique_name.data);
+    if (is_profiled) {
+      fprintf(out_file, "  reglex_profile_action_begin(%d);\n",
+              specs->first_rule);
+    }
+    fprintf(out_file, "  switch (reglex_state->checkpoint_tag) {\n");
+    print_token_actions(specs->tal, specs->unique_name.data);
+    fprintf(out_file, "  default:\n"
+                      "    reglex_no_token();\n"
+                      "    break;\n"
+                      "  }\n");
+    if (is_profiled) {
+      fprintf(out_file, "  reglex_profile_action_end();\n");
+    }
+    fprintf(out_file, "  reglex_reset_to_checkpoint();\n"
+                      "}\n");
     specs = specs->next;
   }
 }
@@ -553,6 +2955,7 @@ static void delete_parser_specs(parser_spec_t *specs) {
     parser_spec_t *next = specs->next;
     delete_token_action_list(specs->tal);
     delete_ast_list(specs->ast_list);
+    delete_position_automaton(specs->positions);
     if (specs->is_named) {
       free(specs->name.data);
     }
@@ -582,6 +2985,20 @@ static struct option OPTIONS_LONG[] = {{"help", no_argument, NULL, 'h'},
                                        {"version", no_argument, NULL, 'v'},
                                        {"debug", no_argument, NULL, 'd'},
                                        {"output", required_argument, NULL, 'o'},
+                                       {"lockstep", no_argument, NULL, 'l'},
+                                       {"max-states", required_argument, NULL,
+                                        's'},
+                                       {"prefix", required_argument, NULL, 'P'},
+                                       {"gen-input", required_argument, NULL,
+                                        'g'},
+                                       {"seed", required_argument, NULL, 'S'},
+                                       {"weights", required_argument, NULL,
+                                        'w'},
+                                       {"worst-case", required_argument, NULL,
+                                        'W'},
+                                       {"timings", no_argument, NULL, 't'},
+                                       {"tables", required_argument, NULL,
+                                        'T'},
                                        {NULL, 0, NULL, 0}};
 
 static char *OPTIONS_HELP[] = {
@@ -589,6 +3006,25 @@ static char *OPTIONS_HELP[] = {
     ['v'] = "print program version",
     ['d'] = "output debug information",
     ['o'] = "set output file name",
+    ['l'] = "run the lexers specified by each FILE in lockstep over the same "
+            "input",
+    ['s'] = "set the number of dfa states, above which a parser is simulated "
+            "bit-parallel (default 10000)",
+    ['P'] = "prefix the public symbols of the lexer with PREFIX_ instead of "
+            "reglex_",
+    ['g'] = "write SIZE bytes (suffixes K, M and G) of random tokens of the "
+            "first parser instead of the lexer",
+    ['S'] = "set the seed of the random tokens (default 1)",
+    ['w'] = "set the weights of the rules in the random tokens as W[:L],... "
+            "in the order of the spec, where L is the mean length of the "
+            "lexems (default 1:8)",
+    ['W'] = "report the input, which each parser reads again the most, and "
+            "write SIZE bytes of it for the first parser instead of the lexer",
+    ['t'] = "print the time and heap growth of each phase of the generator to "
+            "stderr",
+    ['T'] = "encode the transition tables of the push mode as dense, ec "
+            "(equivalence classes) or comb (row displacement with default "
+            "states) and print their sizes to stderr (default dense)",
 };
 
 _Noreturn static void version() {
@@ -607,6 +3043,46 @@ _Noreturn static void usage(int status) {
   exit(status);
 }
 
+static bool_t is_identifier(const char *str) {
+  for (const char *c = str; *c != '\0'; c++) {
+    switch (*c) {
+    case 'a' ... 'z':
+    case 'A' ... 'Z':
+    case '_':
+      break;
+    case '0' ... '9':
+      if (c == str) {
+        return 0;
+      }
+      break;
+    default:
+      return 0;
+    }
+  }
+  return *str != '\0';
+}
+
+// Parses a number of bytes with an optional suffix K, M or G
+static long long parse_size(const char *str) {
+  char *end;
+  long long size = strtoll(str, &end, 10);
+  switch (*end) {
+  case 'K':
+    size <<= 10;
+    end++;
+    break;
+  case 'M':
+    size <<= 20;
+    end++;
+    break;
+  case 'G':
+    size <<= 30;
+    end++;
+    break;
+  }
+  return end == str || *end != '\0' ? -1 : size;
+}
+
 static void handle_option(char opt) {
   switch (opt) {
   case 'o':
@@ -618,6 +3094,55 @@ static void handle_option(char opt) {
   case 'd':
     output_debug_info = 1;
     break;
+  case 'l':
+    lockstep = 1;
+    break;
+  case 't':
+    print_timings = 1;
+    break;
+  case 'T':
+    report_tables = 1;
+    push_tables = 0;
+    while (push_tables < TABLES_ENCODINGS &&
+           strcmp(TABLES_NAMES[push_tables], nac_optarg_trimmed()) != 0) {
+      push_tables++;
+    }
+    if (push_tables == TABLES_ENCODINGS) {
+      errx(EXIT_FAILURE, "Invalid table encoding \"%s\"\n",
+           nac_optarg_trimmed());
+    }
+    break;
+  case 'P':
+    symbol_prefix = nac_optarg_trimmed();
+    if (!is_identifier(symbol_prefix)) {
+      errx(EXIT_FAILURE, "Invalid prefix \"%s\"\n", symbol_prefix);
+    }
+    break;
+  case 'g':
+    gen_input_size = parse_size(nac_optarg_trimmed());
+    if (gen_input_size <= 0) {
+      errx(EXIT_FAILURE, "Invalid size \"%s\"\n", nac_optarg_trimmed());
+    }
+    break;
+  case 'W':
+    worst_case_size = parse_size(nac_optarg_trimmed());
+    if (worst_case_size <= 0) {
+      errx(EXIT_FAILURE, "Invalid size \"%s\"\n", nac_optarg_trimmed());
+    }
+    break;
+  case 'S':
+    gen_seed = strtoull(nac_optarg_trimmed(), NULL, 10);
+    break;
+  case 'w':
+    gen_weights = nac_optarg_trimmed();
+    break;
+  case 's':
+    max_dfa_states = atoi(nac_optarg_trimmed());
+    if (max_dfa_states <= 0) {
+      errx(EXIT_FAILURE, "Invalid number of states \"%s\"\n",
+           nac_optarg_trimmed());
+    }
+    break;
   }
 }
 
@@ -626,7 +3151,8 @@ static void parse_args(int *argc, char ***argv) {
   nac_simple_parse_args(argc, argv, handle_option);
 
   nac_opt_check_excl("hv");
-  nac_opt_check_max_once("hvo");
+  nac_opt_check_excl("gW");
+  nac_opt_check_max_once("hvosPgSwWtT");
 
   if (nac_get_opt('h')) {
     usage(*argc > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -647,6 +3173,14 @@ static void parse_args(int *argc, char ***argv) {
            out_file_name);
     }
   }
+  // The generated input is written to the output instead of the lexer
+  if (gen_input_size > 0 || worst_case_size > 0) {
+    gen_file = out_file;
+    out_file = fopen("/dev/null", "w");
+    if (out_file == NULL) {
+      err(EXIT_FAILURE, "Failed to open /dev/null for the discarded lexer");
+    }
+  }
 
   if (*argc > 0) {
     in_files = malloc(sizeof(char *) * (*argc + 1));
@@ -660,84 +3194,222 @@ static void parse_args(int *argc, char ***argv) {
   nac_cleanup();
 }
 
-int main(int argc, char *argv[]) {
-  parse_args(&argc, &argv);
+// Consumes one lexer spec and prints its state-machines. The c code at the end
+// of the spec is printed to tail, since it must follow the lexer template.
+static int consume_lexer_spec(int lexer, parser_spec_t **specs,
+                              int *parser_idx, FILE *tail) {
+  next_char = EOF;
+  col = 0;
+  ln = 1;
+  just_consumed_nl = 0;
+  has_undo_char = 0;
+  lap(-1);
   consume_next();
-  consume_c(0);
+  consume_c(0, out_file);
   int flags = consume_instructions();
   consume_reg_defs();
 
   if (output_debug_info) {
     fprintf(out_file, " --- Parser spec(s):\n");
   }
-  parser_spec_t *specs = NULL;
-  int parser_idx = 0;
+  bool_t is_default = 1;
   bool_t c;
   do {
-    parser_spec_t *next_specs = malloc(sizeof(parser_spec_t));
-    next_specs->next = specs;
-    next_specs->is_default = parser_idx == 0;
-    next_specs->idx = parser_idx;
-    specs = next_specs;
-    c = consume_token_actions(&specs->tal, &specs->name, &specs->is_named);
+    parser_spec_t *spec = malloc(sizeof(parser_spec_t));
+    spec->next = *specs;
+    spec->is_default = is_default;
+    spec->idx = *parser_idx;
+    spec->lexer = lexer;
+    spec->options = 0;
+    if (flags & INSTR_CASE_INSENSITIVE) {
+      spec->options |= PARSER_CASE_INSENSITIVE;
+    }
+    if (flags & INSTR_FIRST_MATCH) {
+      spec->options |= PARSER_FIRST_MATCH;
+    }
+    if (flags & INSTR_BIT_PARALLEL) {
+      spec->options |= PARSER_BIT_PARALLEL;
+    }
+    spec->positions = NULL;
+    *specs = spec;
+    c = consume_token_actions(&spec->tal, &spec->name, &spec->is_named,
+                              &spec->options);
+    is_default = 0;
 
     // Ensure each parser has a unique name
-    if (specs->is_named) {
-      specs->unique_name = create_string(specs->name.data);
-      append_str_to_str(&specs->unique_name, "_named");
+    if (spec->is_named) {
+      spec->unique_name = create_string(spec->name.data);
+      append_str_to_str(&spec->unique_name, "_named");
+      if (lexer > 0) {
+        char *suffix;
+        asprintf(&suffix, "_%d", lexer);
+        append_str_to_str(&spec->unique_name, suffix);
+        free(suffix);
+      }
     } else {
-      specs->unique_name.length =
-          asprintf(&specs->unique_name.data, "unnamed_%d", parser_idx);
+      spec->unique_name.length =
+          asprintf(&spec->unique_name.data, "unnamed_%d", *parser_idx);
     }
-    specs->ast_list = to_ast_list(specs->tal);
-
-    automaton_t automaton = convert_ast_list_to_automaton(specs->ast_list);
-    automaton_t dfa = determinize(&automaton);
-    automaton_t mdfa = minimize(&dfa);
-
-    if (mdfa.nodes[mdfa.start_index].end_tag != -1) {
+    spec->ast_list = to_ast_list(spec->tal);
+    spec->first_rule = rule_count;
+    rule_count += spec->tal == NULL ? 0 : spec->tal->tag + 1;
+    lap(PHASE_SPEC);
+
+    automaton_t automaton = convert_ast_list_to_automaton(spec->ast_list);
+    merge_rule_tags(spec, &automaton);
+    int node_words = (automaton.size + 63) / 64;
+    uint64_t *closures = nfa_closures(&automaton, node_words);
+    lap(PHASE_NFA);
+
+    if (nfa_accepts_empty(&automaton, closures, node_words)) {
       reject("no token expressions may accept an empty string");
     }
 
     char *parse_token_fn_name;
     asprintf(&parse_token_fn_name, "reglex_parse_token_%s",
-             specs->unique_name.data);
+             spec->unique_name.data);
     char *reject_fn_name;
-    asprintf(&reject_fn_name, "reglex_reject_%s", specs->unique_name.data);
-
-    print_automaton_to_c_code(mdfa, parse_token_fn_name, "reglex_next",
-                              "reglex_accept", reject_fn_name,
-                              REGEX2C_ALL_DECL_STATIC, out_file);
+    asprintf(&reject_fn_name, "reglex_reject_%s", spec->unique_name.data);
 
     if (output_debug_info) {
       fprintf(out_file, "New parser spec (name='%s', unique_name='%s'):\n",
-              specs->is_named ? specs->name.data : "<unnamed>",
-              specs->unique_name.data);
+              spec->is_named ? spec->name.data : "<unnamed>",
+              spec->unique_name.data);
       fprintf(out_file, " Tokens & Actions:\n");
-      print_token_actions_list_debug_info(specs->tal);
+      print_token_actions_list_debug_info(spec->tal);
       fprintf(out_file, " NFA:\n");
       print_automaton(&automaton, out_file);
-      fprintf(out_file, " DFA:\n");
-      print_automaton(&dfa, out_file);
-      fprintf(out_file, " Minimal DFA:\n");
-      print_automaton(&mdfa, out_file);
     }
 
+    bool_t is_generated = gen_input_size > 0 && lexer == 0 && spec->is_default;
+    bool_t is_bit_parallel =
+        use_bit_parallel(spec, &automaton, closures, node_words);
+    lap(PHASE_DFA);
+    if (is_bit_parallel) {
+      // The simulation is printed after the lexer template, which contains
+      // its runtime
+      if (is_generated) {
+        errx(EXIT_FAILURE,
+             "parser '%s' is simulated bit-parallel and has no dfa to generate "
+             "input from",
+             spec->unique_name.data);
+      }
+      if (worst_case_size > 0) {
+        warnx("parser '%s' is simulated bit-parallel, its worst case is not "
+              "searched",
+              spec->unique_name.data);
+      }
+      if (flags & INSTR_PUSH) {
+        errx(EXIT_FAILURE,
+             "parser '%s' is simulated bit-parallel, which push mode does not "
+             "support",
+             spec->unique_name.data);
+      }
+      spec->positions =
+          build_position_automaton(&automaton, closures, node_words);
+      spec->max_token_length = -1;
+      lap(PHASE_BIT_PARALLEL);
+      fprintf(out_file, "static void %s();\n", parse_token_fn_name);
+      if (output_debug_info) {
+        fprintf(out_file, " Bit-parallel simulation with %d positions\n",
+                spec->positions->size);
+      }
+    } else {
+      automaton_t dfa = determinize(&automaton);
+      drop_dead_rules(spec, &dfa);
+      lap(PHASE_DFA);
+      automaton_t mdfa = minimize(&dfa);
+      lap(PHASE_MINIMIZE);
+      spec->max_token_length = longest_token(spec, &mdfa);
+      print_automaton_to_c_code(mdfa, parse_token_fn_name, next_fn_name(spec),
+                                "reglex_accept", reject_fn_name,
+                                REGEX2C_ALL_DECL_STATIC, out_file);
+      lap(PHASE_C_CODE);
+      if (flags & INSTR_PUSH) {
+        print_push_tables(spec, &mdfa);
+      }
+      if (is_generated) {
+        generate_input(spec, &mdfa);
+      }
+      if (worst_case_size > 0) {
+        find_worst_case(spec, &mdfa, lexer == 0 && spec->is_default);
+      }
+      if (output_debug_info) {
+        fprintf(out_file, " DFA:\n");
+        print_automaton(&dfa, out_file);
+        fprintf(out_file, " Minimal DFA:\n");
+        print_automaton(&mdfa, out_file);
+      }
+      delete_automaton(dfa);
+      delete_automaton(mdfa);
+    }
+    print_trailing_context_matchers(spec);
+
     free(parse_token_fn_name);
     free(reject_fn_name);
     parse_token_fn_name = NULL;
     reject_fn_name = NULL;
 
+    free(closures);
     delete_automaton(automaton);
-    delete_automaton(dfa);
-    delete_automaton(mdfa);
+    lap(PHASE_ANALYSIS);
 
-    parser_idx++;
+    (*parser_idx)++;
   } while (c);
 
+  consume_c(1, tail);
+  delete_reg_def_list(defs);
+  defs = NULL;
+  return flags;
+}
+
+int main(int argc, char *argv[]) {
+  parse_args(&argc, &argv);
+
+  // In lockstep mode, each file contains the spec of a separate lexer
+  char *tail_data = NULL;
+  size_t tail_size = 0;
+  FILE *tail = open_memstream(&tail_data, &tail_size);
+  parser_spec_t *specs = NULL;
+  int parser_idx = 0;
+  int lexer_count = 0;
+  int flags = 0;
+  print_symbol_prefix();
+  do {
+    flags |= consume_lexer_spec(lexer_count++, &specs, &parser_idx, tail);
+    if (lockstep && in_files != NULL) {
+      open_next_in_file();
+    }
+  } while (lockstep && fin != NULL);
+  fclose(tail);
+  if ((flags & INSTR_PUSH) && lexer_count > 1) {
+    errx(EXIT_FAILURE, "push mode cannot be combined with lockstep lexers");
+  }
+  if (report_tables && !(flags & INSTR_PUSH)) {
+    warnx("only the push mode has transition tables, -T has no effect");
+  }
+  // The freestanding runtime has neither stdio nor malloc, which these need
+  if (flags & INSTR_FREESTANDING) {
+    const char *needs_libc = NULL;
+    if (flags & INSTR_PUSH) {
+      needs_libc = "push";
+    } else if (flags & INSTR_PROFILE) {
+      needs_libc = "profile";
+    } else if (flags & INSTR_EMIT_MAIN) {
+      needs_libc = "emit_main";
+    }
+    if (needs_libc != NULL) {
+      errx(EXIT_FAILURE,
+           "the instruction freestanding cannot be combined with %s",
+           needs_libc);
+    }
+  }
+
+  lap(-1);
   int declarations_before, declarations_after;
   int switching_before, switching_after;
   int reject_functions_before, reject_functions_after;
+  int next_functions_before, next_functions_after;
   int main_before, main_after;
 
   strstr_bounds(lexer_template, REGLEX_DECLARATIONS, &declarations_before,
@@ -746,32 +3418,49 @@ int main(int argc, char *argv[]) {
                 &switching_after);
   strstr_bounds(lexer_template, REGLEX_REJECT_FUNCTIONS,
                 &reject_functions_before, &reject_functions_after);
+  strstr_bounds(lexer_template, REGLEX_NEXT_FUNCTIONS, &next_functions_before,
+                &next_functions_after);
   strstr_bounds(lexer_template, REGLEX_MAIN, &main_before, &main_after);
 
   fprintsl(out_file, lexer_template, 0, declarations_before);
-
+  print_declarations(specs, lexer_count, flags);
   fprintsl(out_file, lexer_template, declarations_after, switching_before);
-  print_parser_switching(specs);
+  print_parser_switching(specs, lexer_count, flags);
   fprintsl(out_file, lexer_template, switching_after, reject_functions_before);
-  print_reject_functions(specs);
+  print_reject_functions(specs, flags);
+  fprintsl(out_file, lexer_template, reject_functions_after,
+           next_functions_before);
+  print_next_functions(specs);
+  print_bit_parallel_parsers(specs);
+  if (flags & INSTR_PUSH) {
+    print_push_parsers(specs);
+  }
   delete_parser_specs(specs);
-  delete_reg_def_list(defs);
   specs = NULL;
-  defs = NULL;
 
-  fprintsl(out_file, lexer_template, reject_functions_after, main_before);
+  fprintsl(out_file, lexer_template, next_functions_after, main_before);
 
   if (flags & INSTR_EMIT_MAIN) {
     fprintf(out_file, "%s", lexer_main);
   }
 
-  consume_c(1);
+  fwrite(tail_data, 1, tail_size, out_file);
+  free(tail_data);
+  lap(PHASE_OUTPUT);
+  if (print_timings) {
+    print_phase_timings();
+  }
 
   if (out_file != NULL && out_file != stdout) {
     fclose(out_file);
   }
+  if (gen_file != NULL && gen_file != stdout) {
+    fclose(gen_file);
+  }
   free(in_files);
   in_files = NULL;
+  free(regex_out.data);
+  free(regex_text.data);
 
   return EXIT_SUCCESS;
 }
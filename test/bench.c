@@ -0,0 +1,226 @@
+/**
+ * The benchmark harness, which is included at the end of bench.reglex. It
+ * repeats an input file in memory, parses it with the pull functions or, if the
+ * lexer has been generated with the instruction push, with the push functions,
+ * and reports the time and the hardware counters per byte and per token.
+ *
+ * The counters are read through perf_event_open. Counters, which cannot be
+ * opened (e.g. in a container or with a restrictive perf_event_paranoid), are
+ * reported as "-", the time is always reported.
+ */
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_BYTES (8 << 20)
+#define BENCH_RUNS 5
+#define BENCH_CHUNK_SIZE 4096
+
+#define BENCH_CACHE_MISSES(cache)                                              \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                              \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct bench_counter {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+  int fd;
+} bench_counter_t;
+
+static bench_counter_t bench_counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1i-misses", PERF_TYPE_HW_CACHE,
+     BENCH_CACHE_MISSES(PERF_COUNT_HW_CACHE_L1I)},
+    {"L1d-misses", PERF_TYPE_HW_CACHE,
+     BENCH_CACHE_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+};
+
+#define BENCH_COUNTERS (int)(sizeof(bench_counters) / sizeof(bench_counters[0]))
+
+// Opens the counters for this process in user space. Returns the error of the
+// first counter, which cannot be opened, or 0.
+static int bench_open_counters() {
+  int error = 0;
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = bench_counters[i].type;
+    attr.config = bench_counters[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    bench_counters[i].fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (bench_counters[i].fd == -1 && error == 0) {
+      error = errno;
+    }
+  }
+  return error;
+}
+
+static void bench_start_counters() {
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    if (bench_counters[i].fd != -1) {
+      ioctl(bench_counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(bench_counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+// Counters, which have been multiplexed with others, are scaled to the whole
+// run
+static void bench_stop_counters(double *values) {
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    uint64_t data[3];
+    values[i] = -1;
+    if (bench_counters[i].fd == -1) {
+      continue;
+    }
+    ioctl(bench_counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(bench_counters[i].fd, data, sizeof(data)) == sizeof(data) &&
+        data[2] > 0) {
+      values[i] = (double)data[0] * data[1] / data[2];
+    }
+  }
+}
+
+static double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench_run(char *input, size_t length) {
+  bench_tokens = 0;
+#ifdef REGLEX_PUSH
+  reglex_push_ctx_t ctx;
+  reglex_push_init(&ctx);
+  for (size_t pos = 0; pos < length; pos += BENCH_CHUNK_SIZE) {
+    size_t n = length - pos;
+    if (n > BENCH_CHUNK_SIZE) {
+      n = BENCH_CHUNK_SIZE;
+    }
+    if (reglex_push(&ctx, &input[pos], n)) {
+      return 1;
+    }
+  }
+  return reglex_push_end(&ctx);
+#else
+  FILE *is = fmemopen(input, length, "r");
+  reglex_set_is(is, NULL);
+  reglex_parse_result = -1;
+  int result = reglex_parse();
+  fclose(is);
+  return result;
+#endif
+}
+
+static char *bench_read_input(const char *filename, size_t *length) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+  char *data = NULL;
+  size_t size = 0;
+  char chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data = realloc(data, size + n);
+    memcpy(&data[size], chunk, n);
+    size += n;
+  }
+  fclose(file);
+  if (size == 0) {
+    free(data);
+    return NULL;
+  }
+
+  // The input is repeated, so that a run takes long enough to be measured
+  size_t repeats = (BENCH_MIN_BYTES + size - 1) / size;
+  char *input = malloc(size * repeats);
+  for (size_t i = 0; i < repeats; i++) {
+    memcpy(&input[i * size], data, size);
+  }
+  free(data);
+  *length = size * repeats;
+  return input;
+}
+
+static void bench_print(const char *name, double value, size_t bytes,
+                        long tokens) {
+  if (value < 0) {
+    printf("  %-14s %12s %12s\n", name, "-", "-");
+  } else {
+    printf("  %-14s %12.3f %12.3f\n", name, value / bytes, value / tokens);
+  }
+}
+
+// The variant is named after the lexer executable: bench_<variant>_lexer
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s INPUT\n", argv[0]);
+    return 1;
+  }
+  size_t length = 0;
+  char *input = bench_read_input(argv[1], &length);
+  if (input == NULL) {
+    fprintf(stderr, "Cannot read input \"%s\"\n", argv[1]);
+    return 1;
+  }
+  const char *variant = strrchr(argv[0], '/');
+  variant = variant == NULL ? argv[0] : variant + 1;
+  if (strncmp(variant, "bench_", 6) == 0) {
+    variant += 6;
+  }
+  int variant_length = strlen(variant);
+  if (variant_length > 6 &&
+      strcmp(&variant[variant_length - 6], "_lexer") == 0) {
+    variant_length -= 6;
+  }
+
+  int error = bench_open_counters();
+  if (error != 0) {
+    fprintf(stderr, "%.*s: hardware counters unavailable: %s\n",
+            variant_length, variant, strerror(error));
+  }
+
+  // After a warm-up, the counters of the fastest run are reported
+  double best_time = -1;
+  double best_values[BENCH_COUNTERS];
+  if (bench_run(input, length)) {
+    fprintf(stderr, "The input cannot be parsed\n");
+    return 1;
+  }
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    double values[BENCH_COUNTERS];
+    bench_start_counters();
+    double start = bench_now();
+    bench_run(input, length);
+    double time = bench_now() - start;
+    bench_stop_counters(values);
+    if (best_time < 0 || time < best_time) {
+      best_time = time;
+      memcpy(best_values, values, sizeof(values));
+    }
+  }
+
+  printf("%.*s: %zu bytes, %ld tokens\n", variant_length, variant, length,
+         bench_tokens);
+  printf("  %-14s %12s %12s\n", "", "per byte", "per token");
+  bench_print("ns", best_time, length, bench_tokens);
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    bench_print(bench_counters[i].name, best_values[i], length, bench_tokens);
+    if (bench_counters[i].fd != -1) {
+      close(bench_counters[i].fd);
+    }
+  }
+  free(input);
+  return 0;
+}
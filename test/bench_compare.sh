@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+# Compares the lexers of reglex with the equivalent lexers of flex and re2c,
+# if they are installed. Each spec in this directory, which convert_spec.awk
+# can convert and which has an input <spec>_lexer_input.*, is generated by each
+# tool, compiled with the same CC and CFLAGS and run on its input repeated to at
+# least 8 MiB. The generation time, the size of the code of the binary and the
+# throughput of the fastest of 3 runs are printed side by side.
+#
+# Usage: bench_compare.sh REGLEX
+
+LEX=${1:-../reglex}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O3"}
+RUNS=3
+MIN_BYTES=$((8 << 20))
+INPUT=cmp_input.tmp
+
+TOOLS=""
+for tool in flex re2c; do
+  if command -v $tool >/dev/null 2>&1; then
+    TOOLS="$TOOLS $tool"
+  else
+    echo "$tool is not installed, it is left out"
+  fi
+done
+if [ -z "$TOOLS" ]; then
+  echo "Neither flex nor re2c is installed, the comparison is skipped"
+  exit 0
+fi
+
+now_ns() {
+  date +%s%N
+}
+
+# Repeats the input, so that a run takes long enough to be measured
+repeat_input() {
+  cp "$1" "$INPUT"
+  while [ $(wc -c <"$INPUT") -lt $MIN_BYTES ]; do
+    cat "$INPUT" "$INPUT" >"$INPUT.double"
+    mv "$INPUT.double" "$INPUT"
+  done
+}
+
+# Generates the c file of the lexer with the tool and prints the time in ms
+generate() {
+  tool=$1
+  name=$2
+  start=$(now_ns)
+  case $tool in
+  reglex) "$LEX" "$name.reglex" -o "cmp_${name}_reglex.c" ;;
+  flex) flex -o "cmp_${name}_flex.c" "cmp_$name.l" ;;
+  re2c) re2c -o "cmp_${name}_re2c.c" "cmp_$name.re" ;;
+  esac || return 1
+  echo $(((($(now_ns) - start) + 500000) / 1000000))
+}
+
+# Prints the MiB per second of the fastest run
+throughput() {
+  best=""
+  run=0
+  while [ $run -lt $RUNS ]; do
+    start=$(now_ns)
+    "./$1" <"$INPUT" >/dev/null || return 1
+    time=$(($(now_ns) - start))
+    if [ -z "$best" ] || [ $time -lt $best ]; then
+      best=$time
+    fi
+    run=$((run + 1))
+  done
+  awk -v bytes=$(wc -c <"$INPUT") -v ns=$best \
+    'BEGIN { printf "%.1f", bytes / 1048576 / (ns / 1e9) }'
+}
+
+code_size() {
+  if command -v size >/dev/null 2>&1; then
+    size "$1" | awk 'NR == 2 { print $1 }'
+  else
+    wc -c <"$1"
+  fi
+}
+
+for spec in *.reglex; do
+  name=${spec%.reglex}
+  input=$(ls ${name}_lexer_input.* 2>/dev/null | head -n 1)
+  if [ -z "$input" ]; then
+    continue
+  fi
+  reason=""
+  for tool in $TOOLS; do
+    case $tool in
+    flex) file="cmp_$name.l" ;;
+    re2c) file="cmp_$name.re" ;;
+    esac
+    reason=$(awk -v target=$tool -f convert_spec.awk "$spec" 2>&1 >"$file") ||
+      break
+    reason=""
+  done
+  if [ -n "$reason" ]; then
+    echo "$spec: skipped, the spec $reason"
+    rm -f "cmp_$name.l" "cmp_$name.re"
+    continue
+  fi
+
+  repeat_input "$input"
+  echo "$spec on $input repeated to $(wc -c <"$INPUT") bytes ($CC $CFLAGS)"
+  printf "  %-8s %12s %12s %12s\n" "" "generate ms" "code bytes" "MiB/s"
+  for tool in reglex $TOOLS; do
+    bin="cmp_${name}_${tool}"
+    if ! ms=$(generate $tool $name); then
+      printf "  %-8s %s\n" $tool "generation failed"
+      continue
+    fi
+    if ! $CC $CFLAGS "$bin.c" -o "$bin"; then
+      printf "  %-8s %s\n" $tool "compilation failed"
+      continue
+    fi
+    if ! mibs=$(throughput "$bin"); then
+      printf "  %-8s %s\n" $tool "run failed"
+      continue
+    fi
+    printf "  %-8s %12s %12s %12s\n" $tool $ms $(code_size "$bin") $mibs
+  done
+  echo ""
+done
+rm -f "$INPUT"
@@ -0,0 +1,193 @@
+#!/bin/sh
+#
+# Benchmarks the generator on synthesized specs, which grow along one axis at a
+# time, and prints the time of each phase (see reglex -t) per size. The growth
+# line estimates the exponent k of time ~ n^k from the two largest sizes, phases
+# growing superlinear are marked with a "!". All measurements are also written
+# to bench_gen.tsv, one line per axis, size and phase, to be plotted.
+#
+# Usage: bench_gen.sh REGLEX
+
+LEX=${1:-../reglex}
+SIZES=${BENCH_GEN_SIZES:-"25 50 100 200 400"}
+# The definitions are nested through the regex sources, of which reglex allows
+# at most 64, and a class holds at most the 94 printable chars
+DEPTH_SIZES=${BENCH_GEN_DEPTH_SIZES:-"4 8 16 32 60"}
+CLASS_SIZES=${BENCH_GEN_CLASS_SIZES:-"6 12 24 48 94"}
+RUNS=3
+SPEC=bench_gen.reglex
+TSV=bench_gen.tsv
+
+spec_header() {
+  printf '%%%%\n\n%%%%\n\n'
+}
+
+# n keywords: lit0 lit1 ...
+literal_spec() {
+  spec_header
+  printf '%%%%\n\n'
+  i=0
+  while [ $i -lt $1 ]; do
+    printf 'lit%d %%{ %%}\n' $i
+    i=$((i + 1))
+  done
+  printf '[a-z]+[0-9]* %%{ %%}\n'
+}
+
+# n rules with stars, which overlap each other
+regex_spec() {
+  spec_header
+  printf '%%%%\n\n'
+  i=0
+  while [ $i -lt $1 ]; do
+    printf 'r%d[a-z]*[0-9]+ %%{ %%}\n' $i
+    i=$((i + 1))
+  done
+}
+
+# A chain of n definitions, each of which refers to the one before
+depth_spec() {
+  printf '%%%%\n\n%%%%\n\n'
+  printf 'D0 [a-z]\n'
+  i=1
+  while [ $i -lt $1 ]; do
+    printf 'D%d ({D%d}|x)[0-9]?\n' $i $((i - 1))
+    i=$((i + 1))
+  done
+  printf '\n%%%%\n\n{D%d}+ %%{ %%}\n' $(($1 - 1))
+}
+
+# 16 rules, each with a class of n printable chars, which starts at another
+# char for each rule
+class_spec() {
+  spec_header
+  printf '%%%%\n\n'
+  awk -v n=$1 'BEGIN {
+    for (i = 33; i < 127; i++) {
+      c = sprintf("%c", i);
+      chars[i - 33] = c ~ /[a-zA-Z0-9]/ ? c : "\\" c;
+    }
+    for (r = 0; r < 16; r++) {
+      class = "";
+      for (i = 0; i < n; i++) {
+        class = class chars[(r * 7 + i) % 94];
+      }
+      printf "c%d[%s]+ %%{ %%}\n", r, class;
+    }
+  }'
+}
+
+# n named parsers with 4 rules each
+parser_spec() {
+  spec_header
+  printf '%%%%\n\n'
+  i=0
+  while [ $i -lt $1 ]; do
+    printf '%%{ p%d %%}\n\n' $i
+    printf 'p%d %%{ reglex_switch_parser("p%d"); %%}\n' $i $(((i + 1) % $1))
+    printf '[a-z]+ %%{ %%}\n[0-9]+ %%{ %%}\n. %%{ %%}\n\n'
+    i=$((i + 1))
+  done
+}
+
+# Prints the fastest of the runs of reglex as "phase ms KiB" lines, the phase
+# names without spaces, and the peak rss as "peak_rss - KiB"
+measure() {
+  best=""
+  best_total=""
+  run=0
+  while [ $run -lt $RUNS ]; do
+    timings=$("$LEX" -t "$SPEC" -o /dev/null 2>&1 >/dev/null) || {
+      echo "$timings" >&2
+      exit 1
+    }
+    total=$(echo "$timings" | awk '$1 == "total" { print $2 }')
+    if [ -z "$best" ] || awk -v a="$total" -v b="$best_total" \
+      'BEGIN { exit !(a < b) }'; then
+      best=$timings
+      best_total=$total
+    fi
+    run=$((run + 1))
+  done
+  echo "$best" | awk 'NR > 1 && $1 == "peak" {
+    print "peak_rss", "-", $NF;
+    next;
+  }
+  NR > 1 {
+    name = $1;
+    for (i = 2; i <= NF - 2; i++) {
+      name = name "_" $i;
+    }
+    print name, $(NF - 1), $NF;
+  }'
+}
+
+bench_axis() {
+  axis=$1
+  title=$2
+  sizes=$3
+  echo "$title"
+  for n in $sizes; do
+    ${axis}_spec $n >"$SPEC"
+    measure | awk -v axis=$axis -v n=$n '$1 == "peak_rss" {
+      print axis "\t" n "\tpeak_rss\t\t" $NF;
+      next;
+    }
+    { print axis "\t" n "\t" $1 "\t" $2 "\t" $3; }'
+  done >"$TSV.$axis"
+  awk -F '\t' '
+  function growth(phase) {
+    if (ms[last, phase] < 1 || ms[prev, phase] <= 0) {
+      return sprintf("%10s", "-");
+    }
+    k = log(ms[last, phase] / ms[prev, phase]) / log(last / prev);
+    return sprintf("%9.2f%s", k, k > 1.5 ? "!" : " ");
+  }
+  {
+    if (!($2 in seen)) {
+      seen[$2] = 1;
+      sizes[size_count++] = $2;
+    }
+    if ($3 == "peak_rss") {
+      rss[$2] = $5;
+    } else {
+      if (!($3 in known)) {
+        known[$3] = 1;
+        phases[phase_count++] = $3;
+      }
+      ms[$2, $3] = $4;
+    }
+  }
+  END {
+    printf "%8s", "n";
+    for (p = 0; p < phase_count; p++) {
+      printf " %10s", phases[p];
+    }
+    printf " %10s\n", "rss_KiB";
+    for (s = 0; s < size_count; s++) {
+      printf "%8d", sizes[s];
+      for (p = 0; p < phase_count; p++) {
+        printf " %10.3f", ms[sizes[s], phases[p]];
+      }
+      printf " %10d\n", rss[sizes[s]];
+    }
+    last = sizes[size_count - 1];
+    prev = sizes[size_count - 2];
+    printf "%8s", "growth";
+    for (p = 0; p < phase_count; p++) {
+      printf " %s", growth(phases[p]);
+    }
+    printf "\n\n";
+  }' "$TSV.$axis"
+  cat "$TSV.$axis" >>"$TSV"
+  rm -f "$TSV.$axis"
+}
+
+printf 'axis\tn\tphase\tms\tKiB\n' >"$TSV"
+bench_axis literal "Literal rules" "$SIZES"
+bench_axis regex "Regex rules" "$SIZES"
+bench_axis depth "Nesting depth of definitions" "$DEPTH_SIZES"
+bench_axis class "Chars per class (16 rules)" "$CLASS_SIZES"
+bench_axis parser "Named parsers (4 rules each)" "$SIZES"
+rm -f "$SPEC"
+echo "The measurements have been written to test/$TSV"
@@ -0,0 +1,289 @@
+#!/usr/bin/awk -f
+#
+# Converts a simple reglex spec into the equivalent input of flex or re2c:
+#
+#   awk -v target=flex -f convert_spec.awk spec.reglex > spec.l
+#   awk -v target=re2c -f convert_spec.awk spec.reglex > spec.re
+#
+# Only specs, whose constructs map directly, are converted: a single unnamed
+# parser, no instruction but emit_main, no case insensitive groups and code,
+# which uses no function of reglex but reglex_lexem. Otherwise the reason is
+# printed to stderr and the exit status is 2.
+#
+# The re2c lexer scans the whole input from memory, which is read from stdin
+# before, since it is not generated with a refill function.
+
+function unsupported(reason) {
+  print reason > "/dev/stderr";
+  failed = 1;
+  exit 2;
+}
+
+function is_space(c) { return c == " " || c == "\t" || c == "\n" || c == "\r"; }
+
+function literal(c) {
+  if (target == "flex") {
+    return c ~ /[a-zA-Z0-9_]/ ? c : "\\" c;
+  }
+  return c == "\"" || c == "\\" ? "\"\\" c "\"" : "\"" c "\"";
+}
+
+function escaped(c) {
+  if (c == "n" || c == "r" || c == "t") {
+    return target == "flex" ? "\\" c : "\"\\" c "\"";
+  }
+  if (c == "s") {
+    return "\" \"";
+  }
+  return literal(c);
+}
+
+# Classes keep their syntax, only \s is a space and the escapes, which neither
+# tool needs, are dropped
+function convert_class(class, out, i, c, e) {
+  out = "";
+  for (i = 1; i <= length(class); i++) {
+    c = substr(class, i, 1);
+    if (c != "\\") {
+      out = out c;
+      continue;
+    }
+    e = substr(class, ++i, 1);
+    if (e == "s") {
+      out = out " ";
+    } else if (e ~ /[nrt\\^\]\-]/) {
+      out = out "\\" e;
+    } else {
+      out = out e;
+    }
+  }
+  return out;
+}
+
+function convert_regex(re, out, i, j, n, c, body) {
+  out = "";
+  n = length(re);
+  i = 1;
+  while (i <= n) {
+    c = substr(re, i, 1);
+    if (c == "\\") {
+      out = out escaped(substr(re, i + 1, 1));
+      i += 2;
+    } else if (c == "[") {
+      j = i + 1;
+      if (substr(re, j, 1) == "^") {
+        j++;
+      }
+      while (j <= n && substr(re, j, 1) != "]") {
+        j += substr(re, j, 1) == "\\" ? 2 : 1;
+      }
+      out = out convert_class(substr(re, i, j - i + 1));
+      i = j + 1;
+    } else if (c == "{") {
+      j = index(substr(re, i), "}");
+      body = substr(re, i + 1, j - 2);
+      if (body ~ /^[0-9]+(,[0-9]*)?$/ || target == "flex") {
+        out = out "{" body "}";
+      } else {
+        out = out " " body " ";
+      }
+      i += j;
+    } else if (c ~ /[()|*+?]/) {
+      out = out c;
+      i++;
+    } else if (c == ".") {
+      out = out (target == "flex" ? "(.|\\n)" : "[^]");
+      i++;
+    } else {
+      out = out literal(c);
+      i++;
+    }
+  }
+  return out;
+}
+
+function check_code(code) {
+  gsub(/reglex_lexem\(\)/, "", code);
+  if (index(code, "reglex_") > 0) {
+    unsupported("uses functions of reglex besides reglex_lexem");
+  }
+}
+
+BEGIN {
+  if (target != "flex" && target != "re2c") {
+    unsupported("target must be flex or re2c");
+  }
+  section = 0;
+  def_count = 0;
+}
+
+$0 == "%%" && section < 4 {
+  section++;
+  next;
+}
+
+section == 0 {
+  head = head $0 "\n";
+}
+
+section == 1 {
+  for (i = 1; i <= NF; i++) {
+    if ($i != "emit_main") {
+      unsupported("uses the instruction " $i);
+    }
+    has_main = 1;
+  }
+}
+
+section == 2 && NF > 0 {
+  if (NF != 2) {
+    unsupported("has a definition, which is not of the form NAME <regex>");
+  }
+  def_names[def_count] = $1;
+  def_regexes[def_count++] = $2;
+}
+
+section == 3 {
+  rules = rules $0 "\n";
+}
+
+section == 4 {
+  tail = tail $0 "\n";
+}
+
+END {
+  if (failed) {
+    exit 2;
+  }
+  if (!has_main) {
+    unsupported("has no instruction emit_main");
+  }
+  check_code(head);
+  check_code(tail);
+  for (i = 0; i < def_count; i++) {
+    if (index(def_regexes[i], "(?i:") > 0) {
+      unsupported("has case insensitive groups");
+    }
+  }
+
+  rule_count = 0;
+  n = length(rules);
+  pos = 1;
+  while (1) {
+    while (pos <= n && is_space(substr(rules, pos, 1))) {
+      pos++;
+    }
+    if (pos > n) {
+      break;
+    }
+    if (substr(rules, pos, 2) == "%{") {
+      unsupported("has named parsers");
+    }
+    start = pos;
+    while (pos <= n && !is_space(substr(rules, pos, 1))) {
+      pos++;
+    }
+    regex = substr(rules, start, pos - start);
+    while (pos <= n && is_space(substr(rules, pos, 1))) {
+      pos++;
+    }
+    context = "";
+    if (substr(rules, pos, 2) == "/ ") {
+      pos += 2;
+      while (pos <= n && is_space(substr(rules, pos, 1))) {
+        pos++;
+      }
+      start = pos;
+      while (pos <= n && !is_space(substr(rules, pos, 1))) {
+        pos++;
+      }
+      context = substr(rules, start, pos - start);
+      while (pos <= n && is_space(substr(rules, pos, 1))) {
+        pos++;
+      }
+    }
+    if (substr(rules, pos, 2) != "%{") {
+      unsupported("has a rule without code action");
+    }
+    pos += 2;
+    end = index(substr(rules, pos), "%}");
+    if (end == 0) {
+      unsupported("has a code action without %}");
+    }
+    action = substr(rules, pos, end - 1);
+    pos += end + 1;
+    if (index(regex context, "(?i:") > 0) {
+      unsupported("has case insensitive groups");
+    }
+    check_code(action);
+    rule_regexes[rule_count] = convert_regex(regex);
+    if (context != "") {
+      rule_regexes[rule_count] = rule_regexes[rule_count] \
+          (target == "flex" ? "/" : " / ") convert_regex(context);
+    }
+    rule_actions[rule_count++] = action;
+  }
+
+  if (target == "flex") {
+    printf "%%{\n%s#define reglex_lexem() yytext\n%%}\n", head;
+    printf "%%option noyywrap nounput noinput\n\n";
+    for (i = 0; i < def_count; i++) {
+      printf "%s %s\n", def_names[i], convert_regex(def_regexes[i]);
+    }
+    printf "\n%%%%\n\n";
+    for (i = 0; i < rule_count; i++) {
+      printf "%s {%s}\n", rule_regexes[i], rule_actions[i];
+    }
+    printf "\n%%%%\n\n%s\nint main() { return yylex(); }\n", tail;
+    exit 0;
+  }
+
+  printf "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n\n";
+  printf "static const unsigned char *cursor, *marker, *ctxmarker, *limit;\n";
+  printf "static const unsigned char *token;\n";
+  printf "static char *lexem = NULL;\n";
+  printf "static size_t lexem_capacity = 0;\n\n";
+  printf "static const char *reglex_lexem() {\n";
+  printf "  size_t length = cursor - token;\n";
+  printf "  if (length + 1 > lexem_capacity) {\n";
+  printf "    lexem_capacity = 2 * (length + 1);\n";
+  printf "    lexem = realloc(lexem, lexem_capacity);\n";
+  printf "  }\n";
+  printf "  memcpy(lexem, token, length);\n";
+  printf "  lexem[length] = '\\0';\n";
+  printf "  return lexem;\n";
+  printf "}\n\n";
+  printf "#define YYCTYPE unsigned char\n";
+  printf "#define YYCURSOR cursor\n#define YYMARKER marker\n";
+  printf "#define YYCTXMARKER ctxmarker\n#define YYLIMIT limit\n";
+  printf "#define YYFILL() 1\n\n";
+  printf "%s\n", head;
+  printf "static int lex() {\n  for (;;) {\n    token = cursor;\n";
+  printf "    /*!re2c\n      re2c:eof = 0;\n\n";
+  for (i = 0; i < def_count; i++) {
+    printf "      %s = %s;\n", def_names[i], convert_regex(def_regexes[i]);
+  }
+  printf "\n";
+  for (i = 0; i < rule_count; i++) {
+    printf "      %s {%s continue; }\n", rule_regexes[i], rule_actions[i];
+  }
+  printf "      * { return 1; }\n      $ { return 0; }\n    */\n  }\n}\n\n";
+  printf "%s\n", tail;
+  printf "int main() {\n";
+  printf "  size_t length = 0, capacity = 4096;\n";
+  printf "  unsigned char *input = malloc(capacity);\n";
+  printf "  size_t n;\n";
+  printf "  while ((n = fread(&input[length], 1, capacity - length - 1, "
+         "stdin)) > 0) {\n";
+  printf "    length += n;\n";
+  printf "    if (capacity - length == 1) {\n";
+  printf "      capacity *= 2;\n";
+  printf "      input = realloc(input, capacity);\n";
+  printf "    }\n";
+  printf "  }\n";
+  printf "  input[length] = 0;\n";
+  printf "  cursor = input;\n";
+  printf "  limit = input + length;\n";
+  printf "  return lex();\n";
+  printf "}\n";
+}
@@ -0,0 +1,281 @@
+/**
+ * The microbenchmarks of the runtime primitives, which are included at the end
+ * of microbench.reglex, so that they can call the static functions of the
+ * lexer template. Each primitive is called in a loop, whose iterations are
+ * calibrated to take at least 1 ms. After a warm-up of 50 ms, 25 samples of the
+ * loop are measured and the nanoseconds per call are summarized as min, median,
+ * mean, standard deviation and max.
+ *
+ * Usage: microbench_lexer [--json] [NAME]...
+ *
+ * With names, only the primitives of those names are measured. With --json,
+ * the summaries are printed as json instead of a table.
+ */
+#include <math.h>
+#include <time.h>
+
+#define MICRO_SAMPLES 25
+#define MICRO_SAMPLE_NS 1e6
+#define MICRO_MAX_ITERATIONS (1L << 40)
+#define MICRO_WARMUP_NS 5e7
+#define MICRO_INPUT_SIZE (1 << 20)
+#define MICRO_INPUT_MASK (MICRO_INPUT_SIZE - 1)
+
+typedef struct micro_bench {
+  const char *name;
+  void (*setup)();
+  void (*run)(long iterations);
+} micro_bench_t;
+
+typedef struct micro_summary {
+  long iterations;
+  double min;
+  double median;
+  double mean;
+  double stddev;
+  double max;
+} micro_summary_t;
+
+// Results are added to the sink, so that the calls cannot be optimized away
+static volatile long micro_sink = 0;
+static char micro_input[MICRO_INPUT_SIZE];
+static FILE *micro_is = NULL;
+
+static double micro_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void micro_reset_state() {
+  reglex_state_t *state = reglex_state;
+  state->token_start = 0;
+  state->checkpoint = 0;
+  state->pos = 0;
+  state->checkpoint_tag = -1;
+  state->curr_loc = (location_t){.ln = 1, .col = 0, .eol = 0};
+  state->checkpoint_loc = state->curr_loc;
+  state->lexem_start_loc = state->curr_loc;
+  state->has_lexem = 0;
+}
+
+// Sets up the whole input as read, so that no primitive reads the stream
+static void micro_setup_buffered() {
+  reglex_input = realloc(reglex_input, MICRO_INPUT_SIZE);
+  memcpy(reglex_input, micro_input, MICRO_INPUT_SIZE);
+  reglex_input_capacity = MICRO_INPUT_SIZE;
+  reglex_input_length = MICRO_INPUT_SIZE;
+  reglex_input_offset = 0;
+  micro_reset_state();
+}
+
+static void micro_setup_stream() {
+  if (micro_is == NULL) {
+    micro_is = fmemopen(micro_input, MICRO_INPUT_SIZE, "r");
+  }
+  rewind(micro_is);
+  reglex_set_is(micro_is, NULL);
+  free(reglex_input);
+  reglex_input = NULL;
+  reglex_input_capacity = 0;
+  reglex_input_length = 0;
+  reglex_input_offset = 0;
+  micro_reset_state();
+}
+
+// The buffer is dropped at the end of the stream, so that its growth is
+// included in the time per byte
+static void micro_refill(long iterations) {
+  for (long i = 0; i < iterations; i++) {
+    int c = reglex_read_input();
+    if (c == EOF) {
+      micro_setup_stream();
+    }
+    micro_sink += c;
+  }
+}
+
+static void micro_next(long iterations) {
+  reglex_state_t *state = reglex_state;
+  for (long i = 0; i < iterations; i++) {
+    if (state->pos == MICRO_INPUT_SIZE) {
+      micro_reset_state();
+    }
+    micro_sink += reglex_next();
+  }
+}
+
+static void micro_accept(long iterations) {
+  reglex_state_t *state = reglex_state;
+  for (long i = 0; i < iterations; i++) {
+    state->pos = i & MICRO_INPUT_MASK;
+    reglex_accept(i & 7);
+  }
+  micro_sink += state->checkpoint;
+}
+
+static void micro_reset_to_checkpoint(long iterations) {
+  reglex_state_t *state = reglex_state;
+  for (long i = 0; i < iterations; i++) {
+    state->checkpoint_tag = i & 7;
+    state->checkpoint = i & MICRO_INPUT_MASK;
+    state->pos = state->checkpoint + 16;
+    reglex_reset_to_checkpoint();
+  }
+  micro_sink += state->pos;
+}
+
+static void micro_lexem(long iterations, size_t length) {
+  reglex_state_t *state = reglex_state;
+  for (long i = 0; i < iterations; i++) {
+    state->token_start = (i * length) & (MICRO_INPUT_MASK >> 1);
+    state->checkpoint = state->token_start + length;
+    state->has_lexem = 0;
+    micro_sink += reglex_lexem()[0];
+  }
+}
+
+static void micro_lexem_8(long iterations) { micro_lexem(iterations, 8); }
+static void micro_lexem_64(long iterations) { micro_lexem(iterations, 64); }
+
+static void micro_location(long iterations) {
+  reglex_state_t *state = reglex_state;
+  for (long i = 0; i < iterations; i++) {
+    state->lexem_start_loc.col = i;
+    micro_sink += reglex_ln() + reglex_col();
+  }
+}
+
+static void micro_increment_loc(long iterations) {
+  location_t loc = {.ln = 1, .col = 0, .eol = 0};
+  for (long i = 0; i < iterations; i++) {
+    reglex_increment_loc(&loc, micro_input[i & MICRO_INPUT_MASK]);
+  }
+  micro_sink += loc.ln + loc.col;
+}
+
+// The parsers are compared in the reverse order of the spec, so p7 is found
+// first and p0 last. The names are volatile, so the comparisons are not folded.
+static const char *volatile micro_parser_names[] = {"p7", "p0"};
+
+static void micro_switch_parser(long iterations) {
+  for (long i = 0; i < iterations; i++) {
+    reglex_switch_parser(micro_parser_names[i & 1]);
+  }
+  micro_sink += reglex_state->token_parser_fn != NULL;
+}
+
+static const micro_bench_t micro_benches[] = {
+    {"refill", micro_setup_stream, micro_refill},
+    {"next", micro_setup_buffered, micro_next},
+    {"accept", micro_setup_buffered, micro_accept},
+    {"reset_to_checkpoint", micro_setup_buffered, micro_reset_to_checkpoint},
+    {"lexem_8", micro_setup_buffered, micro_lexem_8},
+    {"lexem_64", micro_setup_buffered, micro_lexem_64},
+    {"location", micro_setup_buffered, micro_location},
+    {"increment_loc", micro_setup_buffered, micro_increment_loc},
+    {"switch_parser", micro_setup_buffered, micro_switch_parser},
+};
+
+#define MICRO_BENCHES (int)(sizeof(micro_benches) / sizeof(micro_benches[0]))
+
+static int micro_compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static micro_summary_t micro_measure(const micro_bench_t *bench) {
+  micro_summary_t summary = {.iterations = 1};
+  bench->setup();
+  while (1) {
+    double start = micro_now();
+    bench->run(summary.iterations);
+    if (micro_now() - start >= MICRO_SAMPLE_NS ||
+        summary.iterations >= MICRO_MAX_ITERATIONS) {
+      break;
+    }
+    summary.iterations *= 2;
+  }
+  double start = micro_now();
+  while (micro_now() - start < MICRO_WARMUP_NS) {
+    bench->run(summary.iterations);
+  }
+
+  double samples[MICRO_SAMPLES];
+  double sum = 0;
+  for (int i = 0; i < MICRO_SAMPLES; i++) {
+    double start = micro_now();
+    bench->run(summary.iterations);
+    samples[i] = (micro_now() - start) / summary.iterations;
+    sum += samples[i];
+  }
+  qsort(samples, MICRO_SAMPLES, sizeof(double), micro_compare);
+  summary.min = samples[0];
+  summary.median = samples[MICRO_SAMPLES / 2];
+  summary.mean = sum / MICRO_SAMPLES;
+  summary.max = samples[MICRO_SAMPLES - 1];
+  double squares = 0;
+  for (int i = 0; i < MICRO_SAMPLES; i++) {
+    squares += (samples[i] - summary.mean) * (samples[i] - summary.mean);
+  }
+  summary.stddev = sqrt(squares / (MICRO_SAMPLES - 1));
+  return summary;
+}
+
+static int micro_is_selected(const char *name, int argc, char **argv) {
+  int any = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0) {
+      continue;
+    }
+    if (strcmp(argv[i], name) == 0) {
+      return 1;
+    }
+    any = 1;
+  }
+  return !any;
+}
+
+int main(int argc, char **argv) {
+  int is_json = 0;
+  for (int i = 1; i < argc; i++) {
+    is_json |= strcmp(argv[i], "--json") == 0;
+  }
+  // Names separated by spaces, with a newline every 64 bytes
+  for (int i = 0; i < MICRO_INPUT_SIZE; i++) {
+    micro_input[i] = i % 64 == 63 ? '\n' : i % 8 == 7 ? ' ' : 'a' + i % 26;
+  }
+
+  if (is_json) {
+    printf("{\n  \"samples\": %d,\n  \"benchmarks\": [", MICRO_SAMPLES);
+  } else {
+    printf("%-20s %12s %9s %9s %9s %9s %9s\n", "ns per call", "iterations",
+           "min", "median", "mean", "stddev", "max");
+  }
+  int count = 0;
+  for (int i = 0; i < MICRO_BENCHES; i++) {
+    if (!micro_is_selected(micro_benches[i].name, argc, argv)) {
+      continue;
+    }
+    micro_summary_t s = micro_measure(&micro_benches[i]);
+    if (is_json) {
+      printf("%s\n    {\"name\": \"%s\", \"iterations\": %ld, "
+             "\"min_ns\": %.4f, \"median_ns\": %.4f, \"mean_ns\": %.4f, "
+             "\"stddev_ns\": %.4f, \"max_ns\": %.4f}",
+             count > 0 ? "," : "", micro_benches[i].name, s.iterations, s.min,
+             s.median, s.mean, s.stddev, s.max);
+    } else {
+      printf("%-20s %12ld %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+             micro_benches[i].name, s.iterations, s.min, s.median, s.mean,
+             s.stddev, s.max);
+    }
+    count++;
+  }
+  if (is_json) {
+    printf("\n  ]\n}\n");
+  }
+  if (micro_is != NULL) {
+    fclose(micro_is);
+  }
+  return count > 0 ? 0 : 1;
+}
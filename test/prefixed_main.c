@@ -0,0 +1,26 @@
+/**
+ * Links the lexers of prefixed_words.reglex and prefixed_numbers.reglex, which
+ * have been generated with the prefixes words and numbers, into one program.
+ * Any public symbol of the runtime, which is not renamed, breaks the link. The
+ * exit status is 0, if both lexers parse their input as expected.
+ */
+#include <stdio.h>
+#include <string.h>
+
+int words_parse();
+void words_set_is(FILE *is, const char *filename);
+int words_count();
+
+int numbers_parse();
+void numbers_set_is(FILE *is, const char *filename);
+long numbers_sum();
+
+int main() {
+  char input[] = "one 2 three 45 five";
+  words_set_is(fmemopen(input, strlen(input), "r"), "words");
+  numbers_set_is(fmemopen(input, strlen(input), "r"), "numbers");
+  if (words_parse() != 0 || numbers_parse() != 0) {
+    return 1;
+  }
+  return words_count() == 3 && numbers_sum() == 47 ? 0 : 1;
+}
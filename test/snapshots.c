@@ -0,0 +1,107 @@
+/**
+ * The harness of the snapshot tests, which is included at the end of
+ * snapshots.reglex and snapshots_bounded.reglex. It takes snapshots before
+ * peeked tokens, nested snapshots and a snapshot far behind the lexer, restores
+ * them and checks that the same tokens come back. The exit status is 0, if all
+ * restores behave as expected.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#define LINES 2000
+#define FAR_TOKENS 100
+
+typedef struct saved_token {
+  int type;
+  size_t length;
+  char lexem[16];
+} saved_token_t;
+
+static char input[LINES * 24];
+
+// Consumes count tokens and saves them, returns 0 if the input ended before
+static int read_tokens(saved_token_t *tokens, int count) {
+  for (int i = 0; i < count; i++) {
+    const reglex_token_t *token = reglex_peek_token(0);
+    if (token == NULL || token->length >= sizeof(tokens[i].lexem)) {
+      return 0;
+    }
+    tokens[i].type = token->type;
+    tokens[i].length = token->length;
+    memcpy(tokens[i].lexem, token->lexem, token->length);
+    reglex_consume_token();
+  }
+  return 1;
+}
+
+// Consumes count tokens and compares them with the saved ones
+static int read_same_tokens(const saved_token_t *tokens, int count) {
+  saved_token_t again[FAR_TOKENS];
+  if (!read_tokens(again, count)) {
+    return 0;
+  }
+  for (int i = 0; i < count; i++) {
+    if (again[i].type != tokens[i].type ||
+        again[i].length != tokens[i].length ||
+        memcmp(again[i].lexem, tokens[i].lexem, tokens[i].length) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int main() {
+  size_t input_length = 0;
+  for (int i = 0; i < LINES; i++) {
+    input_length += sprintf(&input[input_length], "x%d = %d;\n", i, 2 * i);
+  }
+  reglex_set_is(fmemopen(input, input_length, "r"), "input");
+  saved_token_t tokens[FAR_TOKENS];
+
+  // A snapshot is taken before the peeked tokens
+  reglex_peek_token(3);
+  reglex_snapshot_t near = reglex_snapshot();
+  if (!read_tokens(tokens, 3) || reglex_restore(near) != 0 ||
+      !read_same_tokens(tokens, 3)) {
+    return 1;
+  }
+  reglex_release(near);
+
+  // Nested snapshots, the inner one is restored and released first
+  reglex_snapshot_t outer = reglex_snapshot();
+  if (!read_tokens(tokens, 2)) {
+    return 1;
+  }
+  reglex_snapshot_t inner = reglex_snapshot();
+  if (!read_tokens(&tokens[2], 2) || reglex_restore(inner) != 0 ||
+      !read_same_tokens(&tokens[2], 2)) {
+    return 1;
+  }
+  reglex_release(inner);
+  if (reglex_restore(outer) != 0 || !read_same_tokens(tokens, 4)) {
+    return 1;
+  }
+  reglex_release(outer);
+
+  // A snapshot far behind the lexer, whose input has been moved
+  reglex_snapshot_t far = reglex_snapshot();
+  if (!read_tokens(tokens, FAR_TOKENS)) {
+    return 1;
+  }
+#ifdef REGLEX_MAX_TOKEN_LENGTH
+  // Bounded lexers drop the input of the snapshots, once their buffer is full
+  if (reglex_restore(far) != 1) {
+    return 1;
+  }
+#else
+  if (reglex_restore(far) != 0 || !read_same_tokens(tokens, FAR_TOKENS)) {
+    return 1;
+  }
+#endif
+  reglex_release(far);
+
+  while (reglex_peek_token(0) != NULL) {
+    reglex_consume_token();
+  }
+  return reglex_parse_result == 0 ? 0 : 1;
+}